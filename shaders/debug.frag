@@ -9,25 +9,28 @@ in vec3 frag_world_pos;
 in vec3 frag_world_normal;
 flat in uint frag_material_id;
 
-// Note: must be kept in sync with c++ (and debug.vert)
-const uint MAX_MATERIALS = 5u;
-const uint MATERIAL_SIZE_FLOATS = 6u;
+// Set once per frame. Must match FrameConstants in c++.
+layout(std140) uniform FrameConstants {
+	mat4 u_view_projection;
+	vec4 u_camera_position; // w is unused
+};
 
-uniform mat4 u_model;
-uniform mat4 u_transform;
-uniform float u_materials[MAX_MATERIALS * MATERIAL_SIZE_FLOATS];
+// Must match MAX_MATERIALS and Material in c++.
+const uint MAX_MATERIALS = 512u;
 
-// This should match what's in c++
 struct Material {
-	vec3 diffuse;
-	vec3 specular;
+	vec4 diffuse; // w is unused
+	vec4 specular; // w is unused
+};
+
+// Uploaded once at startup. Indexed by global material id - 1.
+layout(std140) uniform Materials {
+	Material u_materials[MAX_MATERIALS];
 };
 
+// frag_material_id is already global.
 Material get_material() {
-	uint i = MATERIAL_SIZE_FLOATS * (frag_material_id - 1u);
-	return Material(
-		vec3(u_materials[i + 0u], u_materials[i + 1u], u_materials[i + 2u]),
-		vec3(u_materials[i + 3u], u_materials[i + 4u], u_materials[i + 5u]));
+	return u_materials[frag_material_id - 1u];
 }
 
 float Pi = 3.141592653589793238462643383279502884197169399375105820974944;
@@ -73,7 +76,7 @@ vec3 lighting_for_light(vec3 world_pos, vec3 world_normal, Material material, ve
 	//world_normal = vec3(0.99, 0.0, 0.0);
 	vec3 direction_to_light = direction_from_to(world_pos, light_pos);
 
-	vec3 camera_pos = vec3(0.0, 0.0, -4.0); //TODO: don't hardcode
+	vec3 camera_pos = u_camera_position.xyz;
 
 	float diffuse = dot(world_normal, direction_to_light);
 	if (diffuse < 0.0) return vec3(0.0); // There definitely won't be a specular component.
@@ -87,7 +90,7 @@ vec3 lighting_for_light(vec3 world_pos, vec3 world_normal, Material material, ve
 
 	vec3 light_color = vec3(20.0); //TODO
 	float distance2 = distance2(world_pos, light_pos);
-	return light_color * (diffuse * material.diffuse + specular * material.specular) / distance2;
+	return light_color * (diffuse * material.diffuse.rgb + specular * material.specular.rgb) / distance2;
 }
 
 vec3 calculate_lighting(vec3 world_pos, vec3 world_normal, Material material) {
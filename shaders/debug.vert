@@ -1,22 +1,30 @@
 #version 300 es
 
-in vec3 a_position;
-in vec3 a_normal;
-in uint a_material_id;
+// Locations must match set_attrib_pointers in c++.
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in uint a_material_id;
+// Per instance. Occupies 4 attribute locations.
+layout(location = 3) in mat4 a_model;
 
 out vec3 frag_world_pos;
 out vec3 frag_world_normal;
 flat out uint frag_material_id;
 
-uniform mat4 u_model;
-uniform mat4 u_transform;
+// Set once per frame. Must match FrameConstants in c++.
+layout(std140) uniform FrameConstants {
+	mat4 u_view_projection;
+	vec4 u_camera_position; // w is unused
+};
 
-void main() {
+// Added to a_material_id to make material ids unique across models.
+uniform uint u_material_base;
 
-	vec3 world_pos = (u_model * vec4(a_position, 1.0)).xyz;
-	frag_world_pos = world_pos;
-	frag_world_normal = normalize(vec3(u_model * vec4(a_normal, 0.0)));
-	frag_material_id = a_material_id;
+void main() {
+	vec4 world_pos = a_model * vec4(a_position, 1.0);
+	frag_world_pos = world_pos.xyz;
+	frag_world_normal = normalize(vec3(a_model * vec4(a_normal, 0.0)));
+	frag_material_id = u_material_base + a_material_id;
 
-	gl_Position = u_transform * vec4(a_position, 1.0);
+	gl_Position = u_view_projection * world_pos;
 }
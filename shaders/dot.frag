@@ -9,15 +9,8 @@ in vec3 frag_color;
 in float frag_point_size;
 flat in uint frag_material_id;
 
-uniform highp usampler2D u_material_id_texture;
-
-//TODO: don't hardcode
-const uint VIEWPORT_WIDTH = 1024u;
-const uint VIEWPORT_HEIGHT = 1024u;
-
-uint material_id_at_pixel(uint x, uint y) {
-	return texture(u_material_id_texture, vec2(x, y) / vec2(VIEWPORT_WIDTH, VIEWPORT_HEIGHT)).r;
-}
+// Written by neighbors.frag. Each texel holds the material IDs of (this, right, up, up-right) pixels.
+uniform highp usampler2D u_neighbor_ids;
 
 float bool_to_float(bool b) {
 	return b ? 1.0 : 0.0;
@@ -27,18 +20,14 @@ float texture_sample_fraction() {
 	float frag_x = gl_FragCoord.x;
 	float frag_y = gl_FragCoord.y;
 	float lo_x_f = floor(frag_x);
-	uint lo_x = uint(lo_x_f);
-	uint hi_x = uint(ceil(frag_x));
 	float lo_y_f = floor(frag_y);
-	uint lo_y = uint(lo_y_f);
-	uint hi_y = uint(ceil(frag_y));
 
-	// Note: gl_FragCoord.x ranges from 0..viewport width. Similar for y.
-	// But sampling a texture should sample in 0..1.
-	bool dl = material_id_at_pixel(lo_x, lo_y) == frag_material_id;
-	bool dr = material_id_at_pixel(hi_x, lo_y) == frag_material_id;
-	bool ul = material_id_at_pixel(lo_x, hi_y) == frag_material_id;
-	bool ur = material_id_at_pixel(hi_x, hi_y) == frag_material_id;
+	// gl_FragCoord is at the pixel's center, so the four pixels around it are this one and its right/up neighbors.
+	bvec4 same = equal(texelFetch(u_neighbor_ids, ivec2(lo_x_f, lo_y_f), 0), uvec4(frag_material_id));
+	bool dl = same.x;
+	bool dr = same.y;
+	bool ul = same.z;
+	bool ur = same.w;
 
 	if (dl && dr && ul && ur) return 1.0;
 	if (!dl && !dr && !ul && !ur) return 0.0;
@@ -61,7 +50,7 @@ float texture_sample_fraction() {
 }
 
 float texture_sample_fraction_simple() {
-	return bool_to_float(material_id_at_pixel(uint(round(gl_FragCoord.x)), uint(round(gl_FragCoord.y))) == frag_material_id);
+	return bool_to_float(texelFetch(u_neighbor_ids, ivec2(round(gl_FragCoord.xy)), 0).x == frag_material_id);
 }
 
 // Fn that is 1 from 0..(1 - dieoff), then goes down to 0 linearly.
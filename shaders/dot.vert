@@ -1,33 +1,37 @@
 #version 300 es
 
-in vec3 a_position;
-in vec3 a_normal;
-in uint a_material_id;
+// Locations must match set_attrib_pointers in c++.
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in uint a_material_id;
+// Per instance. Occupies 4 attribute locations.
+layout(location = 3) in mat4 a_model;
 
 out vec3 frag_color;
 out float frag_point_size;
 flat out uint frag_material_id;
 
-// Note: must be kept in sync with c++ (and debug.vert)
-const uint MAX_MATERIALS = 5u;
-const uint MATERIAL_SIZE_FLOATS = 6u;
+// Set once per frame. Must match FrameConstants in c++.
+layout(std140) uniform FrameConstants {
+	mat4 u_view_projection;
+	vec4 u_camera_position; // w is unused
+};
+
+// Added to a_material_id to make material ids unique across models.
+uniform uint u_material_base;
 
-uniform mat4 u_model;
-uniform mat4 u_transform;
-uniform float u_materials[MAX_MATERIALS * MATERIAL_SIZE_FLOATS];
+// Must match MAX_MATERIALS and Material in c++.
+const uint MAX_MATERIALS = 512u;
 
-// This should match what's in c++
 struct Material {
-	vec3 diffuse;
-	vec3 specular;
+	vec4 diffuse; // w is unused
+	vec4 specular; // w is unused
 };
 
-Material get_material() {
-	uint i = MATERIAL_SIZE_FLOATS * (a_material_id - 1u);
-	return Material(
-		vec3(u_materials[i + 0u], u_materials[i + 1u], u_materials[i + 2u]),
-		vec3(u_materials[i + 3u], u_materials[i + 4u], u_materials[i + 5u]));
-}
+// Uploaded once at startup. Indexed by global material id - 1.
+layout(std140) uniform Materials {
+	Material u_materials[MAX_MATERIALS];
+};
 
 float Pi = 3.141592653589793238462643383279502884197169399375105820974944;
 
@@ -77,7 +81,7 @@ vec3 lighting_for_light(vec3 world_pos, vec3 world_normal, Material material, ve
 	//world_normal = vec3(0.99, 0.0, 0.0);
 	vec3 direction_to_light = direction_from_to(world_pos, light_pos);
 
-	vec3 camera_pos = vec3(0.0, 0.0, -4.0); //TODO: don't hardcode
+	vec3 camera_pos = u_camera_position.xyz;
 
 	float diffuse = dot(world_normal, direction_to_light);
 	if (diffuse < 0.0) return vec3(0.0); // There definitely won't be a specular component.
@@ -91,7 +95,7 @@ vec3 lighting_for_light(vec3 world_pos, vec3 world_normal, Material material, ve
 
 	vec3 light_color = vec3(20.0); //TODO
 	float distance2 = distance2(world_pos, light_pos);
-	return light_color * (diffuse * material.diffuse + specular * material.specular) / distance2;
+	return light_color * (diffuse * material.diffuse.rgb + specular * material.specular.rgb) / distance2;
 }
 
 vec3 calculate_lighting(vec3 world_pos, vec3 world_normal, Material material) {
@@ -100,24 +104,26 @@ vec3 calculate_lighting(vec3 world_pos, vec3 world_normal, Material material) {
 }
 
 void main() {
-	lowp vec3 screen_normal = normalize(vec3(u_transform * vec4(a_normal, 0.0)));
+	mat4 transform = u_view_projection * a_model;
+	lowp vec3 screen_normal = normalize(vec3(transform * vec4(a_normal, 0.0)));
 	if (screen_normal.z > 0.0) {
 		// Facing away from the camera
 		discardVertex();
 		return;
 	}
 
-	Material material = get_material();
+	uint material_id = u_material_base + a_material_id;
+	Material material = u_materials[material_id - 1u];
 
-	vec3 world_pos = (u_model * vec4(a_position, 1.0)).xyz;
-	vec3 world_normal = normalize(vec3(u_model * vec4(a_normal, 0.0)));
+	vec3 world_pos = (a_model * vec4(a_position, 1.0)).xyz;
+	vec3 world_normal = normalize(vec3(a_model * vec4(a_normal, 0.0)));
 	vec3 lit_color = calculate_lighting(world_pos, world_normal, material);
 
-	gl_Position = u_transform * vec4(a_position, 1.0);
+	gl_Position = transform * vec4(a_position, 1.0);
 	// As screen_normal approaches 0 (facing perpendicular to screen), get smaller.
 	gl_PointSize = 100.0 * quartic_ease(-screen_normal.z);
 	frag_point_size = gl_PointSize;
 
 	frag_color = lit_color;
-	frag_material_id = a_material_id;
+	frag_material_id = material_id;
 }
@@ -0,0 +1,28 @@
+#version 300 es
+
+// For each screen pixel, gathers the material IDs of it and its right, upper, and upper-right neighbors,
+// so that dot.frag can read all four with one texelFetch instead of four filtered lookups per fragment.
+// Runs once per screen pixel, while dot.frag runs once per pixel per overlapping dot.
+
+precision highp float;
+
+// Output is GL_RGBA16UI: (this, right, up, up-right).
+layout(location = 0) out uvec4 neighbor_ids;
+
+uniform highp usampler2D u_material_id_texture;
+// Screen size in pixels. The material ID texture may be smaller (see material_id_scale in c++), so it's sampled by the fraction of the way across the screen.
+uniform vec2 u_viewport_size;
+
+uint material_id_at_pixel(uint x, uint y) {
+	return texture(u_material_id_texture, vec2(x, y) / u_viewport_size).r;
+}
+
+void main() {
+	uint x = uint(gl_FragCoord.x);
+	uint y = uint(gl_FragCoord.y);
+	neighbor_ids = uvec4(
+		material_id_at_pixel(x, y),
+		material_id_at_pixel(x + 1u, y),
+		material_id_at_pixel(x, y + 1u),
+		material_id_at_pixel(x + 1u, y + 1u));
+}
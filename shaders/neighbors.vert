@@ -0,0 +1,7 @@
+#version 300 es
+
+// Draws one triangle that covers the screen. There are no vertex attributes.
+void main() {
+	vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,13 +1,23 @@
 #version 300 es
 
-in vec3 a_position;
-in uint a_material_id;
+// Locations must match set_attrib_pointers in c++.
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in uint a_material_id;
+// Per instance. Occupies 4 attribute locations.
+layout(location = 2) in mat4 a_model;
 
 flat out uint frag_material_id;
 
-uniform mat4 u_transform;
+// Set once per frame. Must match FrameConstants in c++.
+layout(std140) uniform FrameConstants {
+	mat4 u_view_projection;
+	vec4 u_camera_position; // w is unused
+};
+
+// Added to a_material_id to make material ids unique across models.
+uniform uint u_material_base;
 
 void main() {
-	gl_Position = u_transform * vec4(a_position, 1.0);
-	frag_material_id = a_material_id;
+	gl_Position = u_view_projection * a_model * vec4(a_position, 1.0);
+	frag_material_id = u_material_base + a_material_id;
 }
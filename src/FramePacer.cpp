@@ -0,0 +1,86 @@
+#include "./FramePacer.h"
+
+#include <ctime> // clock_gettime, clock_nanosleep
+#include <iomanip> // setprecision
+#include <ostream>
+
+#include "./util/assert.h"
+
+namespace {
+	const u64 NS_PER_SECOND = 1000000000;
+	// Wake this long before the deadline and spin for the rest.
+	// Linux usually wakes within ~100us, but it can be over 1ms under load.
+	const u64 SPIN_NS = 1500000;
+
+	u64 now_ns() {
+		timespec t;
+		check(clock_gettime(CLOCK_MONOTONIC, &t) == 0);
+		return static_cast<u64>(t.tv_sec) * NS_PER_SECOND + static_cast<u64>(t.tv_nsec);
+	}
+
+	void sleep_until_ns(u64 deadline) {
+		timespec t { static_cast<time_t>(deadline / NS_PER_SECOND), static_cast<long>(deadline % NS_PER_SECOND) };
+		// Returns early (with EINTR) if a signal arrives; the spin makes up for that too.
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, nullptr);
+	}
+
+	u64 period_ns(u32 target_fps) {
+		return target_fps == UNLIMITED_FPS ? 0 : NS_PER_SECOND / target_fps;
+	}
+
+	double ns_to_ms(u64 ns) {
+		return static_cast<double>(ns) / 1e6;
+	}
+}
+
+struct FramePacerImpl {
+	u64 period; // 0 if unlimited
+	u64 deadline; // When the next frame should start
+	u64 last_frame_start;
+	RollingHistogram frame_times;
+};
+
+FramePacer::FramePacer(u32 target_fps) : impl{new FramePacerImpl { period_ns(target_fps), 0, now_ns(), RollingHistogram {} }} {
+	impl->deadline = impl->last_frame_start + impl->period;
+}
+
+FramePacer::~FramePacer() {
+	delete impl;
+}
+
+void FramePacer::set_target_fps(u32 target_fps) {
+	impl->period = period_ns(target_fps);
+	impl->deadline = impl->last_frame_start + impl->period;
+}
+
+void FramePacer::wait_for_next_frame() {
+	u64 now = now_ns();
+	if (impl->period != 0) {
+		if (now + SPIN_NS < impl->deadline) {
+			sleep_until_ns(impl->deadline - SPIN_NS);
+			now = now_ns();
+		}
+		while (now < impl->deadline)
+			now = now_ns();
+
+		// Normally the next deadline is one period later, regardless of how late we woke, so the average rate is exact.
+		// But if a frame ran over by more than a period, don't rush the following frames to catch up.
+		impl->deadline = now > impl->deadline + impl->period ? now + impl->period : impl->deadline + impl->period;
+	}
+
+	impl->frame_times.add(now - impl->last_frame_start);
+	impl->last_frame_start = now;
+}
+
+const RollingHistogram& FramePacer::frame_times() const {
+	return impl->frame_times;
+}
+
+void FramePacer::print(std::ostream& out) const {
+	const RollingHistogram& h = impl->frame_times;
+	std::ios::fmtflags old_flags = out.flags();
+	out << std::fixed << std::setprecision(3)
+		<< "Frame time (ms) over the last " << h.size() << " frames: p50 " << ns_to_ms(h.percentile(0.5))
+		<< ", p99 " << ns_to_ms(h.percentile(0.99)) << ", max " << ns_to_ms(h.max()) << std::endl;
+	out.flags(old_flags);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <iosfwd>
+
+#include "./util/int.h"
+#include "./util/RollingHistogram.h"
+
+// For `target_fps`: don't wait at all.
+const u32 UNLIMITED_FPS = 0;
+const u32 DEFAULT_TARGET_FPS = 60;
+
+struct FramePacerImpl;
+
+/**
+ * Starts each frame on a fixed schedule. Sleeps with an absolute deadline (so errors don't accumulate across frames),
+ * wakes a little early, and spins the rest of the way, since the scheduler may oversleep by a millisecond or more.
+ */
+class FramePacer {
+	FramePacerImpl* impl;
+
+public:
+	explicit FramePacer(u32 target_fps);
+	FramePacer(const FramePacer& other) = delete;
+	~FramePacer();
+
+	void set_target_fps(u32 target_fps);
+	// Call once per frame. Returns when the next frame should start.
+	void wait_for_next_frame();
+	// Time from the start of one frame to the start of the next, in nanoseconds.
+	const RollingHistogram& frame_times() const;
+	// p50, p99, and max frame times.
+	void print(std::ostream& out) const;
+};
@@ -1,13 +0,0 @@
-#pragma once
-
-struct TimerImpl;
-
-class Timer {
-	TimerImpl* impl;
-
-public:
-	Timer();
-	~Timer();
-
-	double tick();
-};
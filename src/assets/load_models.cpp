@@ -0,0 +1,114 @@
+#include "./load_models.h"
+
+#include <chrono>
+#include <iostream>
+
+#include "../model/ModelKind.h"
+#include "../model/parse_model.h"
+
+#include "./model_cache.h"
+
+namespace {
+	struct LoadStats {
+		bool cached;
+		u64 bytes; // Of the cache file if cached, else of the sources
+		std::chrono::duration<double> parse_time;
+	};
+
+	double to_megabytes(u64 bytes) {
+		return static_cast<double>(bytes) / (1024.0 * 1024.0);
+	}
+
+	template <typename T>
+	u64 unindexed_bytes(const IndexedVertices<T>& v) {
+		return u64(v.indices.size()) * sizeof(T);
+	}
+
+	template <typename T>
+	u64 indexed_bytes(const IndexedVertices<T>& v) {
+		return u64(v.vertices.size()) * sizeof(T) + v.indices.size_bytes();
+	}
+
+	// Compares the tri and debug buffers to what they'd be with one vertex per face corner.
+	void print_index_stats(Slice<RenderableModel> renderables) {
+		u64 unindexed = 0;
+		u64 indexed = 0;
+		for (const RenderableModel& r : renderables) {
+			unindexed += unindexed_bytes(r.tris) + unindexed_bytes(r.debug);
+			indexed += indexed_bytes(r.tris) + indexed_bytes(r.debug);
+		}
+		std::cout << "Indexed tri and debug buffers take " << indexed << " bytes instead of " << unindexed
+			<< " (saved " << 100.0 * (1.0 - static_cast<double>(indexed) / static_cast<double>(unindexed)) << "%)" << std::endl;
+	}
+
+	void print_stats(Slice<LoadStats> stats, std::chrono::duration<double> total_time, u32 n_threads) {
+		u32 n_cached = 0;
+		u64 cached_bytes = 0;
+		u32 n_parsed = 0;
+		u64 parsed_bytes = 0;
+		std::chrono::duration<double> parse_time {0};
+		for (const LoadStats& s : stats) {
+			if (s.cached) {
+				++n_cached;
+				cached_bytes += s.bytes;
+			} else {
+				++n_parsed;
+				parsed_bytes += s.bytes;
+				parse_time += s.parse_time;
+			}
+		}
+
+		std::cout << "Loaded " << stats.size() << " models in " << total_time.count() * 1000.0 << "ms on " << n_threads << " threads. "
+			<< n_cached << " from cache (" << to_megabytes(cached_bytes) << "MB)";
+		// Parse time is summed over threads, so this is per-thread throughput.
+		if (n_parsed != 0)
+			std::cout << ", parsed " << n_parsed << " (" << to_megabytes(parsed_bytes) << "MB) at " << to_megabytes(parsed_bytes) / parse_time.count() << "MB/s";
+		std::cout << std::endl;
+	}
+}
+
+LoadedModels load_all_models(const std::string& cwd, const ConvertOptions& options, ThreadPool& thread_pool) {
+	std::string models_dir = cwd + "/models/";
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	DynArray<MappedFile> cache_files = DynArray<MappedFile>::uninitialized(N_MODELS);
+	DynArray<Model> models = DynArray<Model>::uninitialized(N_MODELS);
+	DynArray<RenderableModel> renderables = DynArray<RenderableModel>::uninitialized(N_MODELS);
+	DynArray<LoadStats> stats = DynArray<LoadStats>::uninitialized(N_MODELS);
+	// If any model fails, the others' finished slots are destroyed and the rest left alone.
+	FillGuard<MappedFile> cache_files_guard { cache_files };
+	FillGuard<Model> models_guard { models };
+	FillGuard<RenderableModel> renderables_guard { renderables };
+
+	// Each model is independent, so read, parse, convert and bake them all at once.
+	thread_pool.parallel_for(N_MODELS, [&](u32 i) {
+		std::string path = models_dir + model_kind_name(ModelKind(i));
+		MappedFile mtl_source = MappedFile::open(path + ".mtl");
+		MappedFile obj_source = MappedFile::open(path + ".obj");
+		u64 source_hash = hash_model_sources(mtl_source.slice(), obj_source.slice(), options);
+
+		std::string cache_path = path + ".mdlbin";
+		MappedFile cache = open_model_cache(cache_path, source_hash);
+		if (cache.size() != 0) {
+			CachedModel cached = read_model_cache(cache);
+			models_guard.construct(i, std::move(cached.model));
+			renderables_guard.construct(i, std::move(cached.renderable));
+			stats[i] = LoadStats { true, cache.size(), {} };
+		} else {
+			std::chrono::high_resolution_clock::time_point parse_start = std::chrono::high_resolution_clock::now();
+			models_guard.construct(i, parse_model(mtl_source.slice(), obj_source.slice()));
+			stats[i] = LoadStats { false, mtl_source.size() + obj_source.size(), std::chrono::high_resolution_clock::now() - parse_start };
+
+			renderables_guard.construct(i, convert_model(models[i], options, thread_pool));
+			write_model_cache(cache_path, source_hash, models[i], renderables[i]);
+		}
+		cache_files_guard.construct(i, std::move(cache));
+	});
+	cache_files_guard.finish();
+	models_guard.finish();
+	renderables_guard.finish();
+
+	print_stats(stats.slice(), std::chrono::high_resolution_clock::now() - start, thread_pool.n_threads());
+	print_index_stats(renderables.slice());
+	return LoadedModels { std::move(cache_files), std::move(models), std::move(renderables) };
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "../graphics/convert_model.h"
+#include "../graphics/RenderableModel.h"
+#include "../model/Model.h"
+#include "../util/io.h"
+#include "../util/ThreadPool.h"
+
+// Entries are indexed by ModelKind.
+struct LoadedModels {
+	// `models` and `renderables` may borrow from these. Declared first so it is destroyed last.
+	DynArray<MappedFile> cache_files;
+	DynArray<Model> models;
+	DynArray<RenderableModel> renderables;
+};
+
+// Uses the baked .mdlbin next to each .obj if it is up to date, otherwise parses the sources and rebakes it.
+LoadedModels load_all_models(const std::string& cwd, const ConvertOptions& options, ThreadPool& thread_pool);
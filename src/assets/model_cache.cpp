@@ -0,0 +1,207 @@
+#include "./model_cache.h"
+
+#include <cstdio> // fopen
+#include <cstring> // memcmp, memcpy
+
+#include "../util/hash.h"
+
+namespace {
+	const char MAGIC[4] = { 'M', 'D', 'L', 'B' };
+	// Increment whenever the layout of the header or of any stored type changes, or convert_model gives different output.
+	const u32 FORMAT_VERSION = 3;
+	const u32 SECTION_ALIGNMENT = 16;
+
+	struct Section {
+		u32 offset; // From the start of the file
+		u32 count;
+		u32 element_size; // Catches a changed struct layout even if FORMAT_VERSION wasn't bumped.
+	};
+
+	struct Header {
+		char magic[4];
+		u32 version;
+		u64 source_hash;
+		// Each is an IndexWidth
+		u32 index_width;
+		u32 tri_index_width;
+		u32 debug_index_width;
+		Section materials;
+		Section vertices;
+		Section normals;
+		Section faces;
+		Section tris;
+		Section tri_indices;
+		Section dots;
+		Section debug;
+		Section debug_indices;
+	};
+
+	u32 align_up(u32 offset) {
+		return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+	}
+
+	u32 index_width_to_u32(IndexWidth w) {
+		switch (w) {
+			case IndexWidth::U16: return 0;
+			case IndexWidth::U32: return 1;
+		}
+	}
+
+	bool u32_to_index_width(u32 u, IndexWidth& out) {
+		switch (u) {
+			case 0: out = IndexWidth::U16; return true;
+			case 1: out = IndexWidth::U32; return true;
+			default: return false;
+		}
+	}
+
+	bool section_is_valid(const Section& s, u32 file_size, u32 expected_element_size) {
+		return s.element_size == expected_element_size
+			&& s.offset % SECTION_ALIGNMENT == 0
+			&& s.offset <= file_size
+			&& u64(s.count) * s.element_size <= file_size - s.offset;
+	}
+
+	bool index_section_is_valid(const Section& s, u32 file_size, u32 index_width) {
+		IndexWidth width;
+		return u32_to_index_width(index_width, width) && section_is_valid(s, file_size, index_width_bytes(width));
+	}
+
+	bool header_is_valid(const Header& h, u32 file_size, u64 source_hash) {
+		IndexWidth index_width;
+		return memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0
+			&& h.version == FORMAT_VERSION
+			&& h.source_hash == source_hash
+			&& u32_to_index_width(h.index_width, index_width)
+			&& section_is_valid(h.materials, file_size, sizeof(ParsedMaterial))
+			&& section_is_valid(h.vertices, file_size, sizeof(glm::vec3))
+			&& section_is_valid(h.normals, file_size, sizeof(glm::vec3))
+			&& section_is_valid(h.faces, file_size, index_width == IndexWidth::U16 ? sizeof(Face<u16>) : sizeof(Face<u32>))
+			&& section_is_valid(h.tris, file_size, sizeof(VertexAttributesTri))
+			&& index_section_is_valid(h.tri_indices, file_size, h.tri_index_width)
+			&& section_is_valid(h.dots, file_size, sizeof(VertexAttributesDotOrDebug))
+			&& section_is_valid(h.debug, file_size, sizeof(VertexAttributesDotOrDebug))
+			&& index_section_is_valid(h.debug_indices, file_size, h.debug_index_width);
+	}
+
+	template <typename T>
+	DynArray<T> borrow_section(MappedFile& cache, const Section& s) {
+		if (s.count == 0) return {};
+		T* begin = reinterpret_cast<T*>(cache.mutable_slice().begin() + s.offset);
+		return DynArray<T>::borrow(MutableSlice<T> { begin, s.count });
+	}
+
+	template <typename T>
+	IndexedVertices<T> borrow_indexed_vertices(MappedFile& cache, const Section& vertices, const Section& indices, u32 index_width) {
+		IndexWidth width;
+		check(u32_to_index_width(index_width, width));
+		return IndexedVertices<T> {
+			borrow_section<T>(cache, vertices),
+			width == IndexWidth::U16
+				? IndexBuffer { width, borrow_section<u16>(cache, indices), {} }
+				: IndexBuffer { width, {}, borrow_section<u32>(cache, indices) },
+		};
+	}
+
+	// Assigns each section an offset in the order they are added.
+	class Layout {
+		u32 _size;
+
+	public:
+		inline Layout() : _size{sizeof(Header)} {}
+
+		template <typename T>
+		Section add(Slice<T> elements) {
+			u32 offset = align_up(_size);
+			u32 element_size = sizeof(T);
+			_size = offset + safe_mul(elements.size(), element_size);
+			return Section { offset, elements.size(), element_size };
+		}
+
+		inline u32 size() const { return _size; }
+	};
+
+	template <typename T>
+	void write_section(DynArray<char>& out, const Section& s, Slice<T> elements) {
+		if (s.count != 0)
+			memcpy(out.begin() + s.offset, elements.begin(), s.count * s.element_size);
+	}
+}
+
+u64 hash_model_sources(Slice<char> mtl_source, Slice<char> obj_source, const ConvertOptions& options) {
+	static_assert(sizeof(ConvertOptions) == sizeof(double) + sizeof(u64), "ConvertOptions must have no padding to be hashed");
+	Slice<char> options_bytes { reinterpret_cast<const char*>(&options), sizeof(ConvertOptions) };
+	return hash_bytes(options_bytes, hash_bytes(obj_source, hash_bytes(mtl_source)));
+}
+
+MappedFile open_model_cache(const std::string& file_name, u64 source_hash) {
+	MappedFile cache = MappedFile::open_if_exists(file_name);
+	if (cache.size() < sizeof(Header))
+		return MappedFile {};
+	const Header& header = *reinterpret_cast<const Header*>(cache.slice().begin());
+	return header_is_valid(header, cache.size(), source_hash) ? std::move(cache) : MappedFile {};
+}
+
+CachedModel read_model_cache(MappedFile& cache) {
+	Header header = *reinterpret_cast<const Header*>(cache.slice().begin());
+	IndexWidth index_width;
+	check(u32_to_index_width(header.index_width, index_width));
+	bool u16_faces = index_width == IndexWidth::U16;
+	return CachedModel {
+		Model {
+			borrow_section<ParsedMaterial>(cache, header.materials),
+			borrow_section<glm::vec3>(cache, header.vertices),
+			borrow_section<glm::vec3>(cache, header.normals),
+			index_width,
+			u16_faces ? borrow_section<Face<u16>>(cache, header.faces) : DynArray<Face<u16>> {},
+			u16_faces ? DynArray<Face<u32>> {} : borrow_section<Face<u32>>(cache, header.faces),
+		},
+		RenderableModel {
+			borrow_indexed_vertices<VertexAttributesTri>(cache, header.tris, header.tri_indices, header.tri_index_width),
+			borrow_section<VertexAttributesDotOrDebug>(cache, header.dots),
+			borrow_indexed_vertices<VertexAttributesDotOrDebug>(cache, header.debug, header.debug_indices, header.debug_index_width),
+		},
+	};
+}
+
+void write_model_cache(const std::string& file_name, u64 source_hash, const Model& model, const RenderableModel& renderable) {
+	Layout layout;
+	Header header {
+		{ MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3] },
+		FORMAT_VERSION,
+		source_hash,
+		index_width_to_u32(model.index_width),
+		index_width_to_u32(renderable.tris.indices.width),
+		index_width_to_u32(renderable.debug.indices.width),
+		layout.add(model.materials.slice()),
+		layout.add(model.vertices.slice()),
+		layout.add(model.normals.slice()),
+		model.with_faces([&](auto faces) { return layout.add(faces); }),
+		layout.add(renderable.tris.vertices.slice()),
+		renderable.tris.indices.with_indices([&](auto indices) { return layout.add(indices); }),
+		layout.add(renderable.dots.slice()),
+		layout.add(renderable.debug.vertices.slice()),
+		renderable.debug.indices.with_indices([&](auto indices) { return layout.add(indices); }),
+	};
+
+	DynArray<char> out = DynArray<char>::uninitialized(layout.size());
+	// Zero the alignment padding so identical inputs bake to identical files.
+	memset(out.begin(), 0, out.size());
+	memcpy(out.begin(), &header, sizeof(Header));
+	write_section(out, header.materials, model.materials.slice());
+	write_section(out, header.vertices, model.vertices.slice());
+	write_section(out, header.normals, model.normals.slice());
+	model.with_faces([&](auto faces) { write_section(out, header.faces, faces); });
+	write_section(out, header.tris, renderable.tris.vertices.slice());
+	renderable.tris.indices.with_indices([&](auto indices) { write_section(out, header.tri_indices, indices); });
+	write_section(out, header.dots, renderable.dots.slice());
+	write_section(out, header.debug, renderable.debug.vertices.slice());
+	renderable.debug.indices.with_indices([&](auto indices) { write_section(out, header.debug_indices, indices); });
+
+	// Write to a temporary file and rename, so a crash never leaves a half-written cache that looks valid.
+	std::string temp_file_name = file_name + ".tmp";
+	FILE* file = assert_not_null(fopen(temp_file_name.c_str(), "wb"));
+	check(fwrite(out.begin(), 1, out.size(), file) == out.size());
+	check(fclose(file) == 0);
+	check(rename(temp_file_name.c_str(), file_name.c_str()) == 0);
+}
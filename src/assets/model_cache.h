@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+#include "../graphics/convert_model.h"
+#include "../graphics/RenderableModel.h"
+#include "../model/Model.h"
+#include "../util/io.h"
+
+/*
+ * A .mdlbin file is a baked Model plus its RenderableModel.
+ * Every array is stored at a 16-byte-aligned offset in exactly the layout it has in memory,
+ * so a mapped cache file is used in place: nothing is parsed or copied.
+ */
+
+// Includes the options, since the baked strokes depend on them.
+u64 hash_model_sources(Slice<char> mtl_source, Slice<char> obj_source, const ConvertOptions& options);
+
+// Returns an empty MappedFile if the cache file is missing, from an older format version, or was baked from different sources.
+MappedFile open_model_cache(const std::string& file_name, u64 source_hash);
+
+struct CachedModel {
+	Model model;
+	RenderableModel renderable;
+};
+// All arrays in the result borrow from `cache`, which must outlive them.
+CachedModel read_model_cache(MappedFile& cache);
+
+void write_model_cache(const std::string& file_name, u64 source_hash, const Model& model, const RenderableModel& renderable);
@@ -1,61 +1,69 @@
+#include <chrono>
+#include <cmath>
 #include <iostream>//TODO:KILL
 #include "glm/vec2.hpp"
 
 #include "./util/FixedArray.h"
-#include "./util/io.h"
+#include "./util/FixedTimestep.h"
 #include "./util/Ref.h"
+#include "./util/ThreadPool.h"
+#include "./assets/load_models.h"
 #include "./control/Controller.h"
 #include "./graphics/Graphics.h"
-#include "./model/Model.h"
+#include "./graphics/RenderProfiler.h"
 #include "./model/ModelKind.h"
-#include "./model/parse_model.h"
 #include "./physics/Physics.h"
-#include "./Timer.h"
+#include "./FramePacer.h"
 
 #include "./game.h"
 
 namespace {
-	struct GameState {
-		glm::vec3 player;
+	const u32 SIMULATION_STEPS_PER_SECOND = 120;
+	// At 120 steps per second, this lets rendering drop to 15 FPS before the simulation slows down.
+	const u32 MAX_SIMULATION_STEPS_PER_FRAME = 8;
 
-		GameState() : player{0.0f} {}
+	// Everything the fixed-rate simulation updates. Rendering interpolates between the last two of these.
+	struct SimulationState {
+		Transform player;
 	};
 
-	const char* model_name(ModelKind kind) {
-		switch (kind) {
-			case ModelKind::Player:
-				return "player";
-			case ModelKind::Cylinder:
-				return "cylinder";
-			case ModelKind::COUNT:
-				return nullptr;
-		}
+	SimulationState step_simulation(const SimulationState& state __attribute__((unused)), const ControllerGet& input, float dt __attribute__((unused))) {
+		return SimulationState { Transform { glm::vec3 { input.joy, 0.0f }, glm::quat{} } };
 	}
-	//TODO:MOVE
-	DynArray<Model> load_all_models(const std::string& cwd) {
-		std::string models = cwd + "/models/";
-		return fill_array<Model>{}(N_MODELS, [&](u32 i) {
-			ModelKind k = ModelKind(i);
-			const char* name = model_name(k);
-			std::string mtl_source = read_file(models + name + ".mtl");
-			std::string obj_source = read_file(models + name + ".obj");
-			return parse_model(mtl_source.c_str(), obj_source.c_str());
-		});
+
+	struct GameState {
+		SimulationState previous;
+		SimulationState current;
+		Camera camera;
+
+		GameState()
+			: previous{Transform { glm::vec3 { 0.0f }, glm::quat{} }}, current{previous}, camera{DEFAULT_CAMERA} {}
+	};
+
+	// Frames that run no simulation step would drop one-shot input, so it's saved until a step sees it.
+	void merge_input(ControllerGet& pending, const ControllerGet& latest) {
+		pending.joy = latest.joy;
+		pending.button_is_down = latest.button_is_down;
+		pending.button_just_pressed = pending.button_just_pressed || latest.button_just_pressed;
+		pending.start_just_pressed = pending.start_just_pressed || latest.start_just_pressed;
 	}
 
 	struct Game {
-		Timer timer;
-		DynArray<Model> models;
+		FramePacer pacer;
+		ThreadPool thread_pool;
+		LoadedModels models;
 		Graphics graphics;
 		Physics physics;
 		Controller controller;
 		GameState state;
 
-		Game(const std::string& cwd)
-		: timer{},
-			models{load_all_models(cwd)},
-			graphics{Graphics::start(models.slice(), cwd)},
-			physics { models.slice() },
+		Game(const std::string& cwd, u32 target_fps)
+		: pacer{target_fps},
+			thread_pool{},
+			models{load_all_models(cwd, DEFAULT_CONVERT_OPTIONS, thread_pool)},
+			// Only the GL upload happens here, since it must be on the thread that owns the context.
+			graphics{Graphics::start(models.models.slice(), models.renderables.slice(), cwd, DEFAULT_GRAPHICS_OPTIONS, thread_pool)},
+			physics { models.models.slice(), load_collision_layers(cwd), thread_pool },
 			controller{Controller::start()},
 			state {} {}
 	};
@@ -71,19 +79,69 @@ namespace {
 		draw.push_back(DrawEntity { ModelKind::Player, Transform { glm::vec3(0.0f), glm::quat{} } });
 		draw.push_back(DrawEntity { ModelKind::Cylinder, Transform { glm::vec3(0.0f), glm::quat{} } });
 
+		FixedTimestep timestep { SIMULATION_STEPS_PER_SECOND, MAX_SIMULATION_STEPS_PER_FRAME };
+		ControllerGet input { glm::vec2 { 0.0f }, false, false, false };
+		std::chrono::steady_clock::time_point last_frame = std::chrono::steady_clock::now();
+
 		while (!game.graphics.window_should_close()) {
-			double fps __attribute__((unused)) = game.timer.tick();
-			//std::cout << "FPS: " << fps << std::endl;
-			//std::cout << game.controller.get().joy << std::endl;
+			game.pacer.wait_for_next_frame();
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			u32 n_steps = timestep.advance(static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_frame).count()));
+			last_frame = now;
 
-			draw[0].transform.position = glm::vec3 { game.controller.get().joy, 0.0f };
+			merge_input(input, game.controller.get());
+			//std::cout << input.joy << std::endl;
+			for (u32 i = 0; i != n_steps; ++i) {
+				game.state.previous = game.state.current;
+				game.state.current = step_simulation(game.state.current, input, timestep.step_seconds());
+				input.button_just_pressed = false;
+				input.start_just_pressed = false;
+			}
 
-			game.graphics.render(vec_to_slice(draw));
+			draw[0].transform = interpolate(game.state.previous.player, game.state.current.player, timestep.alpha());
+
+			game.graphics.render(game.state.camera, vec_to_slice(draw));
 		}
+
+		game.pacer.print(std::cout);
+		game.graphics.print_gl_stats(std::cout);
+	}
+
+	// Deterministic, so captures can be compared between builds.
+	void scripted_frame(u32 frame, std::vector<DrawEntity>& draw) {
+		float t = static_cast<float>(frame) / 30.0f;
+		draw.clear();
+		draw.push_back(DrawEntity { ModelKind::Player, Transform { glm::vec3 { std::cos(t), std::sin(t), 0.0f }, glm::angleAxis(t, glm::vec3 { 0.0f, 1.0f, 0.0f }) } });
+		draw.push_back(DrawEntity { ModelKind::Cylinder, Transform { glm::vec3 { 0.0f }, glm::quat{} } });
 	}
 }
 
-void game(const std::string& cwd) {
-	Game game { cwd };
+void game(const std::string& cwd, u32 target_fps) {
+	Game game { cwd, target_fps };
 	play_game(game);
 }
+
+void capture_frames(const std::string& cwd, const std::string& out_dir, u32 n_frames, int png_compression_level) {
+	ThreadPool thread_pool {};
+	LoadedModels models = load_all_models(cwd, DEFAULT_CONVERT_OPTIONS, thread_pool);
+	GraphicsOptions graphics_options = DEFAULT_GRAPHICS_OPTIONS;
+	graphics_options.mode = GraphicsMode::Headless;
+	Graphics graphics = Graphics::start(models.models.slice(), models.renderables.slice(), cwd, graphics_options, thread_pool);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	graphics.profiler().set_tracing(true);
+	std::vector<DrawEntity> draw;
+	for (u32 frame = 0; frame != n_frames; ++frame) {
+		scripted_frame(frame, draw);
+		graphics.render(DEFAULT_CAMERA, vec_to_slice(draw));
+		graphics.capture_frame(out_dir + "/frame_" + std::to_string(frame) + ".png", PngOptions { png_compression_level });
+	}
+	graphics.finish_captures();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Captured " << n_frames << " frames in " << seconds << "s (" << n_frames / seconds << " frames/s)" << std::endl;
+	graphics.print_gl_stats(std::cout);
+	graphics.profiler().finish();
+	graphics.profiler().print(std::cout);
+	graphics.profiler().write_trace(out_dir + "/trace.json");
+}
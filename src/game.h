@@ -2,4 +2,10 @@
 
 #include <string>
 
-void game(const std::string& curent_directory);
+#include "./util/int.h"
+
+// `target_fps` may be UNLIMITED_FPS.
+void game(const std::string& curent_directory, u32 target_fps);
+// Renders a fixed sequence of frames with no window and writes them to `out_directory` as PNGs.
+// `png_compression_level` is 0 to 9.
+void capture_frames(const std::string& current_directory, const std::string& out_directory, u32 n_frames, int png_compression_level);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+struct Camera {
+	glm::vec3 position;
+	glm::vec3 target;
+	glm::vec3 up;
+	float fov_y; // Radians
+	float z_near;
+	float z_far;
+};
+
+// Z axis points towards the camera.
+const Camera DEFAULT_CAMERA {
+	/*position*/ glm::vec3 { 0.0f, 0.0f, 4.0f },
+	/*target*/ glm::vec3 { 0.0f, 0.0f, 0.0f },
+	/*up*/ glm::vec3 { 0.0f, 1.0f, 0.0f },
+	/*fov_y*/ 0.785398163f, // 45 degrees
+	/*z_near*/ 1.0f,
+	/*z_far*/ 10.0f,
+};
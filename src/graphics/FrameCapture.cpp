@@ -0,0 +1,153 @@
+#include "./FrameCapture.h"
+
+#include <cstring> // memcpy
+#include <memory> // shared_ptr
+
+#include "../util/assert.h"
+#include "../util/DynArray.h"
+#include "./read_png.h"
+
+namespace {
+	const u32 BYTES_PER_PIXEL = 3; // GL_RGB, which is what write_png takes.
+
+	// Frames waiting to be encoded hold a full image each, so don't let them pile up if encoding is slower than rendering.
+	u32 max_pending_encodes(const ThreadPool& thread_pool) {
+		return thread_pool.n_threads() * 2;
+	}
+
+	void check_framebuffer_complete() {
+		check(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	}
+
+	GLuint create_renderbuffer(u32 width, u32 height, u32 samples, GLenum format) {
+		GLuint id;
+		glGenRenderbuffers(1, &id);
+		glBindRenderbuffer(GL_RENDERBUFFER, id);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, u32_to_glsizei(samples), format, u32_to_glsizei(width), u32_to_glsizei(height));
+		return id;
+	}
+}
+
+void OffscreenTarget::free() {
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &color);
+	if (depth != 0)
+		glDeleteRenderbuffers(1, &depth);
+}
+
+OffscreenTarget create_offscreen_target(u32 width, u32 height, u32 samples, bool with_depth) {
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	GLuint color = create_renderbuffer(width, height, samples, GL_RGBA8);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	GLuint depth = 0;
+	if (with_depth) {
+		depth = create_renderbuffer(width, height, samples, GL_DEPTH_COMPONENT24);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	}
+	check_framebuffer_complete();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return OffscreenTarget { framebuffer, color, depth };
+}
+
+FrameCapture::FrameCapture(u32 _width, u32 _height, ThreadPool& _thread_pool)
+	: width{_width}, height{_height}, resolved{}, slots{}, next_slot{0}, thread_pool{_thread_pool}, encodes{} {
+	allocate();
+}
+
+void FrameCapture::allocate() {
+	resolved = create_offscreen_target(width, height, /*samples*/ 0, /*with_depth*/ false);
+	size_t size = width * height * BYTES_PER_PIXEL;
+	for (Slot& slot : slots) {
+		glGenBuffers(1, &slot.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_READ);
+		slot.fence = nullptr;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+FrameCapture FrameCapture::create(u32 width, u32 height, ThreadPool& thread_pool) {
+	return FrameCapture { width, height, thread_pool };
+}
+
+void FrameCapture::capture(GLState& gl, GLuint framebuffer, const std::string& file_name, const PngOptions& png_options) {
+	Slot& slot = slots[next_slot];
+	next_slot = (next_slot + 1) % N_FRAMES_IN_FLIGHT;
+	if (slot.fence != nullptr)
+		finish(slot);
+
+	// Resolve (or just copy) into `resolved`, then read that into the PBO.
+	gl.bind_framebuffer(resolved.framebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	GLint w = to_glint(width), h = to_glint(height);
+	glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, resolved.framebuffer); // Back to what `gl` thinks is bound.
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, /*offset into the PBO*/ nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.file_name = file_name;
+	slot.png_options = png_options;
+}
+
+void FrameCapture::finish(Slot& slot) {
+	check(glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, /*timeout ns*/ 10000000000) != GL_WAIT_FAILED);
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+
+	// The PBO is needed again in a few frames, so the encoder gets a copy. It's still bottom-up; write_png flips it.
+	// (std::function must be copyable, so it's shared.)
+	std::shared_ptr<DynArray<u8>> image = std::make_shared<DynArray<u8>>(DynArray<u8>::uninitialized(width * height * BYTES_PER_PIXEL));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, image->size(), GL_MAP_READ_BIT);
+	check(mapped != nullptr);
+	memcpy(image->begin(), mapped, image->size());
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	encodes.wait(max_pending_encodes(thread_pool));
+	u32 w = width, h = height;
+	std::string file_name = slot.file_name;
+	PngOptions png_options = slot.png_options;
+	thread_pool.spawn(encodes, [image, w, h, file_name, png_options]() {
+		write_png(w, h, image->slice(), RowOrder::BottomUp, png_options, file_name.c_str());
+	});
+}
+
+void FrameCapture::finish_all() {
+	// `next_slot` is the oldest.
+	for (u32 i = 0; i != N_FRAMES_IN_FLIGHT; ++i) {
+		Slot& slot = slots[(next_slot + i) % N_FRAMES_IN_FLIGHT];
+		if (slot.fence != nullptr)
+			finish(slot);
+	}
+	encodes.wait();
+}
+
+void FrameCapture::resize(u32 new_width, u32 new_height) {
+	finish_all();
+	free();
+	width = new_width;
+	height = new_height;
+	allocate();
+}
+
+void FrameCapture::free() {
+	for (Slot& slot : slots) {
+		if (slot.fence != nullptr) {
+			glDeleteSync(slot.fence);
+			slot.fence = nullptr;
+		}
+		glDeleteBuffers(1, &slot.pbo);
+	}
+	// An encode that failed has already been reported by `capture` or `finish_all`, unless we're unwinding from it now.
+	encodes.wait_ignoring_errors();
+	resolved.free();
+}
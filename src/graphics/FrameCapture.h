@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+
+#include "../util/ThreadPool.h"
+#include "./gl_types.h"
+#include "./read_png.h"
+#include "./StreamBuffer.h" // N_FRAMES_IN_FLIGHT
+
+// A framebuffer object with renderbuffer attachments, for rendering without a window.
+struct OffscreenTarget {
+	GLuint framebuffer;
+	GLuint color;
+	GLuint depth; // 0 if there's no depth attachment
+
+	void free();
+};
+
+// `samples` of 0 means not multisampled.
+OffscreenTarget create_offscreen_target(u32 width, u32 height, u32 samples, bool with_depth);
+
+/**
+ * Reads rendered frames into pixel buffer objects, and a few frames later hands them to the thread pool to encode as PNGs.
+ * glReadPixels into a PBO returns immediately, so the CPU doesn't wait for each frame to finish on the GPU
+ * the way reading into client memory (or glGetTexImage) would; and encoding happens off the render thread, several frames at a time.
+ */
+class FrameCapture {
+	struct Slot {
+		GLuint pbo;
+		GLsync fence; // nullptr if nothing is pending
+		std::string file_name;
+		PngOptions png_options;
+	};
+
+	u32 width;
+	u32 height;
+	// Multisampled framebuffers can't be read directly, so they're resolved into this first.
+	OffscreenTarget resolved;
+	Slot slots[N_FRAMES_IN_FLIGHT];
+	u32 next_slot;
+	ThreadPool& thread_pool;
+	TaskGroup encodes;
+
+	FrameCapture(u32 _width, u32 _height, ThreadPool& _thread_pool);
+	// Creates `resolved` and the PBOs at the current size.
+	void allocate();
+	// Copies the slot out of its PBO and starts encoding it.
+	void finish(Slot& slot);
+
+public:
+	static FrameCapture create(u32 width, u32 height, ThreadPool& thread_pool);
+
+	// Queues a read of `framebuffer`'s color, to be written to `file_name`.
+	void capture(GLState& gl, GLuint framebuffer, const std::string& file_name, const PngOptions& png_options);
+	// Waits until every captured frame has been written.
+	void finish_all();
+	// Finishes pending captures, since they were read at the old size.
+	void resize(u32 new_width, u32 new_height);
+	// Drops captures not yet read back, and waits for encodes without rethrowing their errors, so it's safe while unwinding.
+	// Call `finish_all` first to keep them.
+	void free();
+};
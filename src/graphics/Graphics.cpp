@@ -1,26 +1,32 @@
 #include "Graphics.h"
 
+#include <algorithm> // max
+#include <cmath> // round
+#include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include <glm/gtc/type_ptr.hpp> // glm::value_ptr
 #include <iostream> // std::cerr
 
 #include "../util/DynArray.h"
+#include "../util/FixedArray.h"
 #include "../util/int.h"
 #include "../util/Matrix.h"
 #include "../util/assert.h"
 #include "../util/math.h"
 #include "../util/Ref.h"
+#include "../util/RollingHistogram.h"
+#include "../util/UniquePtr.h"
 
-#include "./convert_model.h"
+#include "./FrameCapture.h"
 #include "./gl_types.h"
+#include "./headless_context.h"
+#include "./material_table.h"
 #include "./read_png.h"
+#include "./RenderProfiler.h"
 #include "./shader_utils.h"
+#include "./StreamBuffer.h"
 
 namespace {
-	//TODO: not const
-	const uint VIEWPORT_WIDTH = 1024;
-	const uint VIEWPORT_HEIGHT = 1024;
 	const uint MULTISAMPLING = 4;
 }
 
@@ -37,6 +43,18 @@ namespace {
 	}
 
 	struct Size { u32 width; u32 height; };
+
+	bool operator==(const Size& a, const Size& b) {
+		return a.width == b.width && a.height == b.height;
+	}
+
+	Size scale_size(const Size& size, float scale) {
+		return Size {
+			std::max(1u, static_cast<u32>(std::round(static_cast<float>(size.width) * scale))),
+			std::max(1u, static_cast<u32>(std::round(static_cast<float>(size.height) * scale))),
+		};
+	}
+
 	__attribute__((unused))
 	std::pair<Texture, Size> load_texture(const std::string& cwd) {
 		Matrix<u32> m = png_texture_load((cwd + "/textures/foo.png").c_str());
@@ -44,68 +62,120 @@ namespace {
 		//TODO: how to remove the texture when done?
 	}
 
-	//TODO:MOVE
-	struct Matrices {
-		glm::mat4 model;
-		glm::mat4 viewModel; // excludes proj
-		glm::mat4 transform;
+	// Each component of the transforms in its own array, so `write_model_matrices` can process several entities at once.
+	struct TransformsSoA {
+		std::vector<float> px, py, pz;
+		std::vector<float> qx, qy, qz, qw;
+
+		void resize(u32 n) {
+			for (std::vector<float>* v : { &px, &py, &pz, &qx, &qy, &qz, &qw })
+				v->resize(n);
+		}
+
+		void set(u32 i, const Transform& t) {
+			px[i] = t.position.x; py[i] = t.position.y; pz[i] = t.position.z;
+			qx[i] = t.quat.x; qy[i] = t.quat.y; qz[i] = t.quat.z; qw[i] = t.quat.w;
+		}
 	};
-	Matrices get_matrices(const DrawEntity& to_draw) {
-		glm::mat4 model = glm::translate(glm::toMat4(to_draw.transform.quat), to_draw.transform.position); //glm::rotate(glm::mat4{}, time * glm::radians(10.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		glm::mat4 view = glm::lookAt(
-			// Z axis points towards me
-			/*eye*/ glm::vec3(0.0f, 0.0f, 4.0f),
-			/*center*/ glm::vec3(0.0f, 0.0f, 0.0f),
-			/*up*/ glm::vec3(0.0f, 1.0f, 0.0f)
-		);
-		glm::mat4 proj = glm::perspective(glm::radians(45.0f), static_cast<float>(VIEWPORT_WIDTH) / VIEWPORT_HEIGHT, 1.0f, 10.0f);
+
+	// For each i, the same as glm::translate(glm::toMat4(quat), position), but computes only the non-constant entries.
+	// A flat loop over raw arrays, with no branches or bounds checks, so the compiler can vectorize it.
+	void write_model_matrices(const TransformsSoA& t, u32 n, glm::mat4* out_matrices) {
+		const float* px = t.px.data(); const float* py = t.py.data(); const float* pz = t.pz.data();
+		const float* qx = t.qx.data(); const float* qy = t.qy.data(); const float* qz = t.qz.data(); const float* qw = t.qw.data();
+		float* out = static_cast<float*>(static_cast<void*>(out_matrices));
+		for (u32 i = 0; i != n; ++i) {
+			float xx = qx[i] * qx[i], yy = qy[i] * qy[i], zz = qz[i] * qz[i];
+			float xy = qx[i] * qy[i], xz = qx[i] * qz[i], yz = qy[i] * qz[i];
+			float wx = qw[i] * qx[i], wy = qw[i] * qy[i], wz = qw[i] * qz[i];
+			float c00 = 1.0f - 2.0f * (yy + zz), c01 = 2.0f * (xy + wz), c02 = 2.0f * (xz - wy);
+			float c10 = 2.0f * (xy - wz), c11 = 1.0f - 2.0f * (xx + zz), c12 = 2.0f * (yz + wx);
+			float c20 = 2.0f * (xz + wy), c21 = 2.0f * (yz - wx), c22 = 1.0f - 2.0f * (xx + yy);
+
+			// Column-major, like glm::mat4.
+			float* m = out + i * 16;
+			m[0] = c00; m[1] = c01; m[2] = c02; m[3] = 0.0f;
+			m[4] = c10; m[5] = c11; m[6] = c12; m[7] = 0.0f;
+			m[8] = c20; m[9] = c21; m[10] = c22; m[11] = 0.0f;
+			m[12] = c00 * px[i] + c10 * py[i] + c20 * pz[i];
+			m[13] = c01 * px[i] + c11 * py[i] + c21 * pz[i];
+			m[14] = c02 * px[i] + c12 * py[i] + c22 * pz[i];
+			m[15] = 1.0f;
+		}
+	}
+
+	// Must match the `FrameConstants` block in the shaders (std140 layout).
+	struct FrameConstants {
+		glm::mat4 view_projection;
+		glm::vec4 camera_position; // w is unused
+	};
+	const GLuint FRAME_CONSTANTS_BINDING = 0;
+	const GLuint MATERIALS_BINDING = 1;
+
+	FrameConstants get_frame_constants(const Camera& camera, const Size& screen_size) {
+		glm::mat4 view = glm::lookAt(camera.position, camera.target, camera.up);
+		glm::mat4 proj = glm::perspective(camera.fov_y, static_cast<float>(screen_size.width) / static_cast<float>(screen_size.height), camera.z_near, camera.z_far);
 		if ((false))
 			proj = glm::ortho<float>(
 				/*left*/ 0,
-				/*right*/ VIEWPORT_WIDTH,
+				/*right*/ static_cast<float>(screen_size.width),
 				/*bottom*/ 0,
-				/*top*/ VIEWPORT_HEIGHT,
+				/*top*/ static_cast<float>(screen_size.height),
 				/*zNear*/ -2.0f,
 				/*zFar*/ 2.0f);
 
-		glm::mat4 viewModel = view * model;
-		glm::mat4 total =  proj * viewModel;
-		return { model, viewModel, total };
+		return FrameConstants { proj * view, glm::vec4 { camera.position, 1.0f } };
 	}
 
-	Texture create_framebuffer_texture() {
+	UniformBuffer create_uniform_buffer(GLuint binding, size_t size) {
+		GLuint id;
+		glGenBuffers(1, &id);
+		glBindBuffer(GL_UNIFORM_BUFFER, id);
+		glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+		return UniformBuffer { gluint_to_u32(id) };
+	}
+
+	void bind_uniform_block(const Shaders& shaders, const char* block_name, GLuint binding) {
+		GLuint index = glGetUniformBlockIndex(shaders.program.id, block_name);
+		check(index != GL_INVALID_INDEX);
+		glUniformBlockBinding(shaders.program.id, index, binding);
+	}
+
+	Texture create_framebuffer_texture(const Size& size, GLint internal_format, GLenum format, GLenum type) {
 		GLuint id; // render to this
 		glGenTextures(1, &id);
 		glBindTexture(GL_TEXTURE_2D, id);
 		glTexImage2D(
 			GL_TEXTURE_2D,
 			/*mipmap level*/ 0,
-			GL_R32UI,
-			VIEWPORT_WIDTH,
-			VIEWPORT_HEIGHT,
+			internal_format,
+			u32_to_glsizei(size.width),
+			u32_to_glsizei(size.height),
 			/*must be 0*/ 0,
-			GL_RED_INTEGER,
-			GL_UNSIGNED_BYTE,
+			format,
+			type,
 			nullptr); // data uninitialized (will write to it using framebuffer)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		return Texture { id };
 	}
 
-	FrameBuffer create_framebuffer() {
+	FrameBuffer create_framebuffer(const Size& size, GLint internal_format, GLenum format, GLenum type, bool with_depth) {
 		GLuint frame_buffer_id;
 		glGenFramebuffers(1, &frame_buffer_id);
 		glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer_id);
 
-		Texture rendered_texture = create_framebuffer_texture();
+		Texture rendered_texture = create_framebuffer_texture(size, internal_format, format, type);
 
 		// Need a renderbuffer for depth.
-		GLuint render_buffer_id;
-		glGenRenderbuffers(1, &render_buffer_id);
-		glBindRenderbuffer(GL_RENDERBUFFER, render_buffer_id);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, render_buffer_id);
+		GLuint render_buffer_id = 0;
+		if (with_depth) {
+			glGenRenderbuffers(1, &render_buffer_id);
+			glBindRenderbuffer(GL_RENDERBUFFER, render_buffer_id);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, u32_to_glsizei(size.width), u32_to_glsizei(size.height));
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, render_buffer_id);
+		}
 
 		// This frame buffer only needs one attachment. At least one color attachment must exist, so use that.
 
@@ -131,7 +201,18 @@ namespace {
 
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);//TODO: shouldn't be necessary
 
-		return { frame_buffer_id, rendered_texture };
+		return { frame_buffer_id, rendered_texture, render_buffer_id };
+	}
+
+	// Written by the tri pass.
+	FrameBuffer create_material_id_framebuffer(const Size& size) {
+		return create_framebuffer(size, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, /*with_depth*/ true);
+	}
+
+	// Written by neighbors.frag. Global material IDs go up to MAX_MATERIALS, so 16 bits is enough.
+	static_assert(MAX_MATERIALS <= std::numeric_limits<u16>::max(), "Material IDs must fit in GL_RGBA16UI");
+	FrameBuffer create_neighbor_ids_framebuffer(const Size& size) {
+		return create_framebuffer(size, GL_RGBA16UI, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, /*with_depth*/ false);
 	}
 }
 
@@ -147,6 +228,24 @@ namespace {
 		return vbo;
 	}
 
+	GLenum gl_index_type(IndexWidth width) {
+		switch (width) {
+			case IndexWidth::U16: return GL_UNSIGNED_SHORT;
+			case IndexWidth::U32: return GL_UNSIGNED_INT;
+		}
+	}
+
+	// Must be called with the VAO bound, so that the VAO remembers this buffer.
+	IBO create_and_bind_index_buffer(const IndexBuffer& indices) {
+		GLuint ibo_id;
+		glGenBuffers(1, &ibo_id);
+		check(ibo_id != 0);
+		IBO ibo { ibo_id, indices.size(), gl_index_type(indices.width) };
+		ibo.bind();
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.data(), GL_STATIC_DRAW);
+		return ibo;
+	}
+
 	Uniform get_uniform(const Shaders& shaders, const char* name) {
 		GLint id = glGetUniformLocation(shaders.program.id, name);
 		check(id != -1); // NOTE: if this fails, perhaps the uniform was unused
@@ -163,43 +262,22 @@ namespace {
 	}
 
 
-	void init_glew() {
+	void init_glew(bool headless) {
 		glewExperimental = GL_TRUE;
 		// Must be done after glut is initialized!
 		GLenum res = glewInit();
-		if (res != GLEW_OK) {
+		// GLEW built for GLX complains that there's no X display, but the GL functions are loaded by then.
+		if (res != GLEW_OK && !(headless && res == GLEW_ERROR_NO_GLX_DISPLAY)) {
 			std::cerr << "Error: " << glewGetErrorString(res) << std::endl;
 			assert(false);
 		}
 	}
 
-	template <typename Cb>
-	inline void enabling(GLenum enabled, Cb cb) {
-		assert(!glIsEnabled(enabled));
-		glEnable(enabled);
-		cb();
-		glDisable(enabled);
-	}
-	template <typename Cb>
-	inline void enabling(GLenum a, GLenum b, Cb cb) {
-		enabling(a, [&]() {
-			enabling(b, cb);
-		});
-	}
-
-	void save_image(const Texture& texture, uint width, uint height, const char* file_name) {
-		DynArray<u8> image_data = DynArray<u8>::uninitialized(width * height * 3); // * 10 to make sure error isn't due to size
-		glBindTexture(GL_TEXTURE_2D, texture.id);
-		glGetTexImage(GL_TEXTURE_2D, /*mipmap level*/ 0, GL_RGB, GL_UNSIGNED_BYTE, image_data.begin());
-		//glGetTextureImage(texture.id, /*mipmap level*/ 0, GL_RGB, GL_UNSIGNED_BYTE, image_data.size(), image_data.begin());
-		write_png(width, height, image_data.slice(), file_name);
-	}
-
 	struct RenderableModelInfo {
-		RenderableModel renderable_model;
-		VAOInfo vao_info_tris;
+		IndexedVAOInfo vao_info_tris;
 		VAOInfo vao_info_dots;
-		VAOInfo vao_info_debug;
+		IndexedVAOInfo vao_info_debug;
+		u32 material_base; // See MaterialTable
 
 		void free() {
 			vao_info_tris.free();
@@ -208,166 +286,366 @@ namespace {
 		}
 	};
 
-	void uniform_matrix(const Uniform& u, const glm::mat4 mat) {
-		glUniformMatrix4fv(u.id, 1, /*transpose*/ GL_FALSE, glm::value_ptr(mat));
+	struct InstanceRange {
+		u32 first;
+		u32 count;
+	};
+
+	/**
+	 * Per-instance model matrices, rewritten every frame.
+	 * Instances are grouped by model so that each model is drawn with one instanced draw call.
+	 */
+	class InstanceStream {
+		StreamBuffer buffer;
+		FixedArray<N_MODELS, InstanceRange> ranges; // Indexed by ModelKind
+		// This frame's transforms in instance order. Kept to reuse its memory.
+		TransformsSoA sorted;
+
+		static const u32 INITIAL_CAPACITY = 256;
+
+	public:
+		explicit InstanceStream(StreamBuffer _buffer) : buffer{_buffer}, ranges{}, sorted{} {}
+
+		static InstanceStream create() {
+			return InstanceStream { StreamBuffer::create(GL_ARRAY_BUFFER, INITIAL_CAPACITY * sizeof(glm::mat4)) };
+		}
+
+		inline const InstanceRange& range(ModelKind kind) {
+			return ranges[model_kind_to_u32(kind)];
+		}
+
+		inline void bind(GLState& gl) const {
+			buffer.bind(gl);
+		}
+
+		// Byte offset in the buffer of this frame's instance `i`.
+		inline size_t offset_of(u32 instance) const {
+			return buffer.region_offset() + instance * sizeof(glm::mat4);
+		}
+
+		// A counting sort by model, since there are only a few kinds.
+		// Call `end_frame` after drawing.
+		void upload(GLState& gl, Slice<DrawEntity> to_draw) {
+			for (InstanceRange& r : ranges.mutable_slice())
+				r = InstanceRange { 0, 0 };
+			for (const DrawEntity& d : to_draw)
+				++ranges[model_kind_to_u32(d.model)].count;
+			u32 first = 0;
+			for (InstanceRange& r : ranges.mutable_slice()) {
+				r.first = first;
+				first += r.count;
+			}
+
+			// Sort first, so the matrices are computed in one pass in the order they're stored.
+			sorted.resize(to_draw.size());
+			FixedArray<N_MODELS, u32> cursors;
+			for (u32 i = 0; i != N_MODELS; ++i)
+				cursors[i] = ranges[i].first;
+			for (const DrawEntity& d : to_draw)
+				sorted.set(cursors[model_kind_to_u32(d.model)]++, d.transform);
+
+			// Writes straight into the mapped buffer; there's no separate upload.
+			MutableSlice<glm::mat4> out = buffer.begin_frame<glm::mat4>(gl, to_draw.size());
+			write_model_matrices(sorted, to_draw.size(), out.begin());
+		}
+
+		inline void end_frame() {
+			buffer.end_frame();
+		}
+
+		void free() {
+			buffer.free();
+		}
+	};
+
+	// In pixels. May differ from the size the window was created with, because of HiDPI scaling or the user resizing it.
+	Size get_framebuffer_size(GLFWwindow* window) {
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+		return Size { int_to_uint(width), int_to_uint(height) };
 	}
 
-	// Should match what's in the shader.
-	constexpr uint MAX_MATERIALS = 5u;
+	// Stands in for the window.
+	struct Headless {
+		HeadlessContext context;
+		// The dot pass draws here instead of to the window. Multisampled like the window is.
+		OffscreenTarget screen;
+		FrameCapture capture;
+	};
+
+	// Over every frame so far, for `print_gl_stats`.
+	struct GLStatsTotals {
+		u32 n_frames;
+		u64 binds;
+		u64 redundant_binds;
+		u64 draw_calls;
+		u64 fence_wait_ns;
+		RollingHistogram recent_fence_wait_ns;
+
+		void add(const GLFrameStats& frame) {
+			++n_frames;
+			binds += frame.binds;
+			redundant_binds += frame.redundant_binds;
+			draw_calls += frame.draw_calls;
+			fence_wait_ns += frame.fence_wait_ns;
+			recent_fence_wait_ns.add(frame.fence_wait_ns);
+		}
+	};
+
+	double ns_to_ms(u64 ns) {
+		return static_cast<double>(ns) / 1e6;
+	}
+
+	double per_frame(u64 count, u32 n_frames) {
+		return static_cast<double>(count) / static_cast<double>(n_frames);
+	}
 }
 
 struct GraphicsImpl {
-	GLFWwindow* window;
+	GLFWwindow* window; // Null if headless
+	UniquePtr<Headless> headless; // Null if there's a window
+	// In pixels, which on a HiDPI display is more than the window's size in screen coordinates.
+	Size screen_size;
+	// `frame_buffer` is `screen_size` scaled by this.
+	float material_id_scale;
+	// Material IDs for the dot pass. Reallocated when the screen's size or `material_id_scale` changes.
 	FrameBuffer frame_buffer;
+	// Screen-sized; see neighbors.frag. Also reallocated on resize.
+	FrameBuffer neighbor_ids;
 	ShadersInfo<TriUniforms> tri_shader_info;
+	ShadersInfo<NeighborsUniforms> neighbors_shader_info;
 	ShadersInfo<DotUniforms> dot_shader_info;
 	ShadersInfo<DebugUniforms> debug_shader_info;
+	// The neighbors pass has no vertex attributes, but something must be bound to draw.
+	VAO empty_vao;
 	// This should be as long as ModelKind has entries. (TODO: use a fixed-size array then.)
 	DynArray<RenderableModelInfo> renderable_models;
+	InstanceStream instances;
+	UniformBuffer frame_constants;
+
+	UniformBuffer materials; // Never changes after `start`.
+	GLState gl;
+	RenderProfiler profiler;
+	GLFrameStats last_frame_stats;
+	GLStatsTotals gl_totals;
+
+	// What the window would show.
+	GLuint screen_framebuffer() {
+		return headless.ptr() == nullptr ? 0 : headless->screen.framebuffer;
+	}
 
-	//TODO: this should come from parsed materials file!!!
-	Material materials[MAX_MATERIALS] = {
-		// Note: first material id is 1, so this is offset.
-		// r g b r g b
-		{ glm::vec3(1.0, 1.0, 0.0), glm::vec3(1.0, 1.0, 1.0) },
-		{ glm::vec3(0.0, 1.0, 1.0), glm::vec3(1.0, 1.0, 1.0) },
-		{ glm::vec3(1.0, 0.0, 1.0), glm::vec3(1.0, 1.0, 0.0) },
-		{ glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 1.0, 0.0) },
-		{ glm::vec3(0.0, 1.0, 1.0), glm::vec3(1.0, 1.0, 0.0) },
-	};
+	Size material_id_size() const {
+		return scale_size(screen_size, material_id_scale);
+	}
+
+	void resize(const Size& new_screen_size) {
+		screen_size = new_screen_size;
+		frame_buffer.free();
+		frame_buffer = create_material_id_framebuffer(material_id_size());
+		neighbor_ids.free();
+		neighbor_ids = create_neighbor_ids_framebuffer(screen_size);
+		if (headless.ptr() != nullptr) {
+			headless->screen.free();
+			headless->screen = create_offscreen_target(screen_size.width, screen_size.height, MULTISAMPLING, /*with_depth*/ true);
+			headless->capture.resize(screen_size.width, screen_size.height);
+		}
+		// The above bound things directly.
+		gl.forget();
+	}
+
+	void set_material_id_scale(float scale) {
+		check(scale > 0.0f && scale <= 1.0f);
+		material_id_scale = scale;
+		resize(screen_size);
+	}
 
 	const RenderableModelInfo& get_model(ModelKind m) {
 		return renderable_models[model_kind_to_u32(m)];
 	}
 
-	void render_debug(Slice<DrawEntity> to_draw) {
-		enabling(GL_DEPTH_TEST, [&]() {
-			glClear(static_cast<uint>(GL_COLOR_BUFFER_BIT) | static_cast<uint>(GL_DEPTH_BUFFER_BIT));
-			glClearColor(0.0f, 0.0f, 0.1f, 0.0f);
+	// Calls `cb(model, range)` for each model with at least one instance this frame.
+	template <typename Cb>
+	void each_instanced_model(Cb cb) {
+		for (u32 i = 0; i != N_MODELS; ++i) {
+			ModelKind kind = ModelKind(i);
+			const InstanceRange& range = instances.range(kind);
+			if (range.count != 0)
+				cb(get_model(kind), range);
+		}
+	}
 
-			for (const DrawEntity& d : to_draw) {
-				const RenderableModelInfo& r = get_model(d.model);
-				r.vao_info_debug.vao.bind();
-				debug_shader_info.shaders.use();//TODO: move out?
+	// Call with the model's VAO bound.
+	void bind_instances(ShadersKind kind, const InstanceRange& range) {
+		instances.bind(gl);
+		set_instance_attrib_pointers(kind, instances.offset_of(range.first));
+	}
 
-				Matrices matrices = get_matrices(d);
+	// Each pass sets every capability it depends on, since the previous pass may have left it either way.
+	void render_debug() {
+		profiler.begin(RenderPass::Debug);
+		gl.bind_framebuffer(screen_framebuffer());
+		gl.set_enabled(GL_DEPTH_TEST, true);
+		gl.set_enabled(GL_BLEND, false);
 
-				uniform_matrix(debug_shader_info.uniforms.u_model, matrices.model);
-				uniform_matrix(debug_shader_info.uniforms.u_transform, matrices.transform);
-				set_uniform_materials(debug_shader_info.uniforms.u_materials);
+		glClear(static_cast<uint>(GL_COLOR_BUFFER_BIT) | static_cast<uint>(GL_DEPTH_BUFFER_BIT));
+		glClearColor(0.0f, 0.0f, 0.1f, 0.0f);
 
-				r.vao_info_debug.vbo.bind();
-				glDrawArrays(GL_TRIANGLES, 0, u32_to_glsizei(r.vao_info_debug.vbo.n_vertices));
-			}
-		});
-	}
+		gl.use(debug_shader_info.shaders);
 
-	//TODO: should only have to do this once at the beginning...
-	void set_uniform_materials(Uniform u) {
-		glUniform1fv(u.id, MAX_MATERIALS * sizeof(Material) / sizeof(float), reinterpret_cast<float*>(materials));
+		each_instanced_model([&](const RenderableModelInfo& r, const InstanceRange& range) {
+			glUniform1ui(debug_shader_info.uniforms.u_material_base.id, r.material_base);
+			gl.bind(r.vao_info_debug.vao);
+			bind_instances(ShadersKind::Debug, range);
+			gl.draw_elements_instanced(GL_TRIANGLES, r.vao_info_debug.ibo, range.count);
+		});
+		profiler.end();
 	}
 
-	void render_normal(Slice<DrawEntity> to_draw) {
+	void render_normal() {
 		// Draw triangles
-		enabling(GL_DEPTH_TEST, [&]() {
-			// First pass: draw to the frame buffer
-			glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer.id);
-			//TODO:needed?
-			glViewport(0, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+		// First pass: draw to the frame buffer
+		profiler.begin(RenderPass::Tri);
+		gl.bind_framebuffer(frame_buffer.id);
+		gl.set_enabled(GL_DEPTH_TEST, true);
+		gl.set_enabled(GL_BLEND, false);
+		Size id_size = material_id_size();
+		glViewport(0, 0, u32_to_glsizei(id_size.width), u32_to_glsizei(id_size.height));
+
+		glClear(static_cast<uint>(GL_COLOR_BUFFER_BIT) | static_cast<uint>(GL_DEPTH_BUFFER_BIT));
+		glClearColor(0.0f, 0.0f, 0.1f, 0.0f);
+
+		gl.use(tri_shader_info.shaders);
+		each_instanced_model([&](const RenderableModelInfo& r, const InstanceRange& range) {
+			glUniform1ui(tri_shader_info.uniforms.u_material_base.id, r.material_base);
+			gl.bind(r.vao_info_tris.vao);
+			bind_instances(ShadersKind::Tri, range);
+			gl.draw_elements_instanced(GL_TRIANGLES, r.vao_info_tris.ibo, range.count);
+		});
+		profiler.end();
 
-			glClear(static_cast<uint>(GL_COLOR_BUFFER_BIT) | static_cast<uint>(GL_DEPTH_BUFFER_BIT));
+		if ((true)) {
+			// Gather each pixel's neighborhood of material IDs, so the dot pass needs one fetch per fragment.
+			profiler.begin(RenderPass::Neighbors);
+			gl.bind_framebuffer(neighbor_ids.id);
+			gl.set_enabled(GL_DEPTH_TEST, false);
+			gl.set_enabled(GL_BLEND, false);
+			glViewport(0, 0, u32_to_glsizei(screen_size.width), u32_to_glsizei(screen_size.height));
+			gl.use(neighbors_shader_info.shaders);
+			gl.bind(frame_buffer.output_texture);
+			glUniform1i(neighbors_shader_info.uniforms.u_material_id_texture.id, 0);
+			// The material ID texture may be smaller than the screen, so the shader samples it by the fraction of the way across the screen.
+			glUniform2f(neighbors_shader_info.uniforms.u_viewport_size.id, static_cast<float>(screen_size.width), static_cast<float>(screen_size.height));
+			gl.bind(empty_vao);
+			// One triangle covering the screen.
+			gl.draw_arrays_instanced(GL_TRIANGLES, 3, 1);
+			profiler.end();
+
+			// Now render to screen.
+			profiler.begin(RenderPass::Dot);
+			gl.bind_framebuffer(screen_framebuffer());
+			gl.set_enabled(GL_DEPTH_TEST, false);
+			gl.set_enabled(GL_VERTEX_PROGRAM_POINT_SIZE, true);
+			gl.set_enabled(GL_BLEND, true);
+
+			glClear(static_cast<uint>(GL_COLOR_BUFFER_BIT));
 			glClearColor(0.0f, 0.0f, 0.1f, 0.0f);
 
-			for (const DrawEntity& d : to_draw) {
-				const RenderableModelInfo& r = get_model(d.model);
-				r.vao_info_tris.vao.bind();
-				tri_shader_info.shaders.use();//TODO: move out?
-				Matrices matrices = get_matrices(d);
-				uniform_matrix(tri_shader_info.uniforms.u_transform, matrices.transform);
-				r.vao_info_tris.vbo.bind();
-				glDrawArrays(GL_TRIANGLES, 0, u32_to_glsizei(r.vao_info_tris.vbo.n_vertices));
-			}
-
-			//Verified: we're indeed writing to the texture
-			if ((false)) {
-				DynArray<u8> image_data = DynArray<u8>::uninitialized(VIEWPORT_WIDTH * VIEWPORT_HEIGHT * 3);
-				save_image(frame_buffer.output_texture, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, "/home/andy/CLionProjects/myproject/texture.png");
+			gl.use(dot_shader_info.shaders);
 
-				// Reads pixels directly from frame buffer
-				//glReadnPixels(0, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, image_data.size(), image_data.begin());
-				//write_png(VIEWPORT_WIDTH, VIEWPORT_HEIGHT, image_data.slice(), "/home/andy/CLionProjects/myproject/screen.png");
+			//TODO: check for error after trying to set uniform?
+			//TODO: Yes this is tricky. Have to bind a texture and set the uniform to the texture *unit*, not the texture id.
+			gl.bind(neighbor_ids.output_texture);
+			glUniform1i(dot_shader_info.uniforms.u_neighbor_ids.id, 0);//frame_buffer.output_texture.id); //TODO: just guessing here
 
-				todo();
-			}
-		});
-
-
-		if ((true)) {
-			enabling(GL_VERTEX_PROGRAM_POINT_SIZE, GL_BLEND, [&]() {
-				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-				// Now render to screen.
-				glBindFramebuffer(GL_FRAMEBUFFER, 0);
-				//TODO:needed?
-				glViewport(0, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
-
-				glClear(static_cast<uint>(GL_COLOR_BUFFER_BIT));
-				glClearColor(0.0f, 0.0f, 0.1f, 0.0f);
-
-				for (const DrawEntity& d : to_draw) {
-					const RenderableModelInfo& r = get_model(d.model);
-
-					const VAOInfo& dots = r.vao_info_dots;
-					dots.vao.bind();
-					dot_shader_info.shaders.use(); //TODO:MOVE out?
-					Matrices matrices = get_matrices(d);
-					uniform_matrix(dot_shader_info.uniforms.u_model, matrices.model);
-					uniform_matrix(dot_shader_info.uniforms.u_transform, matrices.transform);
-					set_uniform_materials(dot_shader_info.uniforms.u_materials);
-
-					//TODO: check for error after trying to set uniform?
-					//TODO: Yes this is tricky. Have to bind a texture and set the uniform to the texture *unit*, not the texture id.
-					glBindTexture(GL_TEXTURE_2D, frame_buffer.output_texture.id);
-					glUniform1i(dot_shader_info.uniforms.u_material_id_texture.id, 0);//frame_buffer.output_texture.id); //TODO: just guessing here
-
-					dots.vbo.bind();
-					glDrawArrays(GL_POINTS, 0, u32_to_glsizei(dots.vbo.n_vertices));
-				}
+			each_instanced_model([&](const RenderableModelInfo& r, const InstanceRange& range) {
+				glUniform1ui(dot_shader_info.uniforms.u_material_base.id, r.material_base);
+				const VAOInfo& dots = r.vao_info_dots;
+				gl.bind(dots.vao);
+				bind_instances(ShadersKind::Dot, range);
+				gl.draw_arrays_instanced(GL_POINTS, dots.vbo.n_vertices, range.count);
 			});
+
+			profiler.end();
 		}
 	}
 
-	void render(Slice<DrawEntity> to_draw) {
-		//TODO:PERF sort to_draw by the model to avoid rebinding?
+	void render(const Camera& camera, Slice<DrawEntity> to_draw) {
+		if (window != nullptr) {
+			Size size = get_framebuffer_size(window);
+			// Minimized; there's nothing to draw to.
+			if (size.width == 0 || size.height == 0) {
+				glfwPollEvents();
+				return;
+			}
+			if (!(size == screen_size))
+				resize(size);
+		}
+
+		profiler.begin_frame();
+		profiler.begin(RenderPass::Upload);
+		FrameConstants constants = get_frame_constants(camera, screen_size);
+		gl.bind(frame_constants);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameConstants), &constants);
+		instances.upload(gl, to_draw);
+		profiler.end();
 
 		if ((false)) {
-			render_debug(to_draw);
+			render_debug();
 		} else {
-			render_normal(to_draw);
+			render_normal();
+		}
+		// After the last draw that reads this frame's instances.
+		instances.end_frame();
+
+		last_frame_stats = gl.end_frame();
+		gl_totals.add(last_frame_stats);
+
+		if (window != nullptr) {
+			profiler.begin(RenderPass::Swap);
+			glfwSwapBuffers(window);
+			profiler.end();
+			glfwPollEvents();
 		}
+	}
 
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+	void capture_frame(const std::string& file_name, const PngOptions& png_options) {
+		check(headless.ptr() != nullptr);
+		profiler.begin(RenderPass::Capture);
+		headless->capture.capture(gl, screen_framebuffer(), file_name, png_options);
+		profiler.end();
 	}
 
 	~GraphicsImpl() {
 		for (RenderableModelInfo& i : renderable_models)
 			i.free();
+		instances.free();
+		frame_constants.free();
+		materials.free();
 		frame_buffer.free();
+		neighbor_ids.free();
+		profiler.free();
+		glDeleteVertexArrays(1, &empty_vao.id);
 
 		tri_shader_info.free();
+		neighbors_shader_info.free();
 		dot_shader_info.free();
 
-		glfwDestroyWindow(window);
-		glfwTerminate();
+		if (window != nullptr) {
+			glfwDestroyWindow(window);
+			glfwTerminate();
+		} else {
+			headless->capture.free();
+			headless->screen.free();
+			destroy_headless_context(headless->context);
+		}
 	}
 };
 
 namespace {
-	GLFWwindow* init_glfw() {
+	GLFWwindow* init_glfw(u32 width, u32 height) {
 		glfwInit();
 		glfwWindowHint(GLFW_SAMPLES, MULTISAMPLING);
-		GLFWwindow* window = glfwCreateWindow(VIEWPORT_WIDTH, VIEWPORT_HEIGHT, "My window", nullptr, nullptr);
+		GLFWwindow* window = glfwCreateWindow(uint_to_int(width), uint_to_int(height), "My window", nullptr, nullptr);
 		assert(window != nullptr);
 		glfwMakeContextCurrent(window);
 		return window;
@@ -403,48 +681,127 @@ namespace {
 		return VAOInfo { vao, vbo };
 	}
 
-	RenderableModelInfo get_renderable_model_info(const Model& model, const Shaders& shaders_tri, const Shaders& shaders_dot, const Shaders& shaders_debug) {
-		RenderableModel renderable_model = convert_model(model);
+	template <typename TVertexAttributes>
+	IndexedVAOInfo get_indexed_vao_info(const IndexedVertices<TVertexAttributes>& vertices, const Shaders& shaders, ShadersKind shaders_kind) {
+		VAO vao = create_and_bind_vao();
+		VBO vbo = create_and_bind_vertex_buffer(vertices.vertices.slice());
+		IBO ibo = create_and_bind_index_buffer(vertices.indices);
+		set_attrib_pointers(shaders, shaders_kind);
+		return IndexedVAOInfo { vao, vbo, ibo };
+	}
 
-		VAOInfo vao_info_tris = get_vao_info(renderable_model.tris.slice(), shaders_tri, ShadersKind::Tri);
+	// GL copies the vertex data, so `renderable_model` doesn't need to outlive this.
+	RenderableModelInfo get_renderable_model_info(const RenderableModel& renderable_model, u32 material_base, const Shaders& shaders_tri, const Shaders& shaders_dot, const Shaders& shaders_debug) {
+		IndexedVAOInfo vao_info_tris = get_indexed_vao_info(renderable_model.tris, shaders_tri, ShadersKind::Tri);
 		VAOInfo vao_info_dots = get_vao_info(renderable_model.dots.slice(), shaders_dot, ShadersKind::Dot);
-		VAOInfo vao_info_debug = get_vao_info(renderable_model.debug.slice(), shaders_debug, ShadersKind::Debug);
+		IndexedVAOInfo vao_info_debug = get_indexed_vao_info(renderable_model.debug, shaders_debug, ShadersKind::Debug);
 
-		return RenderableModelInfo { std::move(renderable_model), vao_info_tris, vao_info_dots, vao_info_debug };
+		return RenderableModelInfo { vao_info_tris, vao_info_dots, vao_info_debug, material_base };
 	}
 }
 
-Graphics Graphics::start(Slice<Model> models, const std::string& cwd) {
-	GLFWwindow* window = init_glfw();
-
-	init_glew();
+Graphics Graphics::start(Slice<Model> models, Slice<RenderableModel> renderables, const std::string& cwd, const GraphicsOptions& options, ThreadPool& thread_pool) {
+	check(renderables.size() == models.size());
+	check(options.material_id_scale > 0.0f && options.material_id_scale <= 1.0f);
+	MaterialTable material_table = build_material_table(models);
+
+	GLFWwindow* window = nullptr;
+	UniquePtr<Headless> headless;
+	Size screen_size { options.width, options.height };
+	switch (options.mode) {
+		case GraphicsMode::Window:
+			window = init_glfw(options.width, options.height);
+			init_glew(/*headless*/ false);
+			screen_size = get_framebuffer_size(window);
+			break;
+		case GraphicsMode::Headless: {
+			HeadlessContext context = create_headless_context();
+			init_glew(/*headless*/ true);
+			headless = UniquePtr<Headless> { new Headless {
+				context,
+				create_offscreen_target(screen_size.width, screen_size.height, MULTISAMPLING, /*with_depth*/ true),
+				FrameCapture::create(screen_size.width, screen_size.height, thread_pool),
+			} };
+			break;
+		}
+	}
 
 	glEnable(GL_MULTISAMPLE);
+	// Only used by the dot pass, which turns GL_BLEND on.
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	glEnable(GL_DEBUG_OUTPUT);
 	glDebugMessageCallback(gl_debug_message_callback, nullptr);
 
-	FrameBuffer frame_buffer = create_framebuffer();
+	FrameBuffer frame_buffer = create_material_id_framebuffer(scale_size(screen_size, options.material_id_scale));
+	FrameBuffer neighbor_ids = create_neighbor_ids_framebuffer(screen_size);
 
 	Shaders shaders_tri = compile_shaders("tri", cwd);
-	TriUniforms uniforms_tri { get_uniform(shaders_tri, "u_transform") };
+	TriUniforms uniforms_tri { get_uniform(shaders_tri, "u_material_base") };
+	Shaders shaders_neighbors = compile_shaders("neighbors", cwd);
+	NeighborsUniforms uniforms_neighbors { get_uniform(shaders_neighbors, "u_material_id_texture"), get_uniform(shaders_neighbors, "u_viewport_size") };
 	Shaders shaders_dot = compile_shaders("dot", cwd);
-	DotUniforms uniforms_dot { get_uniform(shaders_dot, "u_model"), get_uniform(shaders_dot, "u_transform"), get_uniform(shaders_dot, "u_materials"), get_uniform(shaders_dot, "u_material_id_texture") };
+	DotUniforms uniforms_dot { get_uniform(shaders_dot, "u_material_base"), get_uniform(shaders_dot, "u_neighbor_ids") };
 	Shaders shaders_debug = compile_shaders("debug", cwd);
-	DebugUniforms uniforms_debug { get_uniform(shaders_debug, "u_model"), get_uniform(shaders_debug, "u_transform"), get_uniform(shaders_debug, "u_materials") };
+	DebugUniforms uniforms_debug { get_uniform(shaders_debug, "u_material_base") };
+
+	UniformBuffer frame_constants = create_uniform_buffer(FRAME_CONSTANTS_BINDING, sizeof(FrameConstants));
+	bind_uniform_block(shaders_tri, "FrameConstants", FRAME_CONSTANTS_BINDING);
+	bind_uniform_block(shaders_dot, "FrameConstants", FRAME_CONSTANTS_BINDING);
+	bind_uniform_block(shaders_debug, "FrameConstants", FRAME_CONSTANTS_BINDING);
+
+	// The shaders declare MAX_MATERIALS entries, so the buffer must be that big even if fewer are used.
+	UniformBuffer materials = create_uniform_buffer(MATERIALS_BINDING, MAX_MATERIALS * sizeof(Material));
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, material_table.materials.size() * sizeof(Material), material_table.materials.begin());
+	bind_uniform_block(shaders_dot, "Materials", MATERIALS_BINDING);
+	bind_uniform_block(shaders_debug, "Materials", MATERIALS_BINDING);
+
+	DynArray<RenderableModelInfo> renderable_models = DynArray<RenderableModelInfo>::uninitialized(renderables.size());
+	for (u32 i = 0; i != renderables.size(); ++i)
+		renderable_models[i] = get_renderable_model_info(renderables[i], material_table.bases[i], shaders_tri, shaders_dot, shaders_debug);
 
 	return Graphics { new GraphicsImpl {
 		window,
+		std::move(headless),
+		screen_size,
+		options.material_id_scale,
 		frame_buffer,
+		neighbor_ids,
 		ShadersInfo<TriUniforms> { shaders_tri, uniforms_tri },
+		ShadersInfo<NeighborsUniforms> { shaders_neighbors, uniforms_neighbors },
 		ShadersInfo<DotUniforms> { shaders_dot, uniforms_dot },
 		ShadersInfo<DebugUniforms> { shaders_debug, uniforms_debug },
-		map<RenderableModelInfo>{}(models, [&](const Model& model) { return get_renderable_model_info(model, shaders_tri, shaders_dot, shaders_debug); }),
+		create_and_bind_vao(),
+		std::move(renderable_models),
+		InstanceStream::create(),
+		frame_constants,
+		materials,
+		// Setup above bound things directly, so this starts out knowing nothing.
+		GLState {},
+		RenderProfiler::create(),
+		GLFrameStats { 0, 0, 0, 0 },
+		GLStatsTotals { 0, 0, 0, 0, 0, RollingHistogram {} },
 	} };
 }
 
+const GLFrameStats& Graphics::last_frame_stats() const {
+	return _impl->last_frame_stats;
+}
+
+void Graphics::print_gl_stats(std::ostream& out) const {
+	const GLStatsTotals& t = _impl->gl_totals;
+	if (t.n_frames == 0)
+		return;
+	out << "Per frame: " << per_frame(t.binds, t.n_frames) << " binds, " << per_frame(t.redundant_binds, t.n_frames) << " redundant binds dropped, "
+		<< per_frame(t.draw_calls, t.n_frames) << " draw calls" << std::endl;
+	const RollingHistogram& recent = t.recent_fence_wait_ns;
+	out << "Over " << t.n_frames << " frames, waited " << ns_to_ms(t.fence_wait_ns) << "ms for the GPU to free stream buffers. Per frame, over the last "
+		<< recent.size() << ": p50 " << ns_to_ms(recent.percentile(0.5)) << "ms, p95 " << ns_to_ms(recent.percentile(0.95)) << "ms, max "
+		<< ns_to_ms(recent.max()) << "ms" << std::endl;
+}
+
 bool Graphics::window_should_close() {
-	return int_to_bool(glfwWindowShouldClose(_impl->window));
+	return _impl->window != nullptr && int_to_bool(glfwWindowShouldClose(_impl->window));
 }
 
 Graphics::~Graphics() {
@@ -452,6 +809,31 @@ Graphics::~Graphics() {
 	//TODO: free VAO
 }
 
-void Graphics::render(Slice<DrawEntity> to_draw) {
-	_impl->render(to_draw);
+void Graphics::render(const Camera& camera, Slice<DrawEntity> to_draw) {
+	_impl->render(camera, to_draw);
+}
+
+void Graphics::set_size(u32 width, u32 height) {
+	if (_impl->window != nullptr)
+		// `render` notices the framebuffer's new size.
+		glfwSetWindowSize(_impl->window, uint_to_int(width), uint_to_int(height));
+	else
+		_impl->resize(Size { width, height });
+}
+
+void Graphics::set_material_id_scale(float scale) {
+	_impl->set_material_id_scale(scale);
+}
+
+void Graphics::capture_frame(const std::string& file_name, const PngOptions& png_options) {
+	_impl->capture_frame(file_name, png_options);
+}
+
+RenderProfiler& Graphics::profiler() {
+	return _impl->profiler;
+}
+
+void Graphics::finish_captures() {
+	check(_impl->headless.ptr() != nullptr);
+	_impl->headless->capture.finish_all();
 }
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <iosfwd>
 #include <string>
 
+#include "../util/ThreadPool.h"
 #include "../util/Transform.h"
 #include "../model/Model.h"
 #include "../model/ModelKind.h"
+#include "./Camera.h"
+#include "./read_png.h"
+#include "./RenderableModel.h"
 
 /**
  * This is the input to the graphics system: Draw a model at a certain transform.
@@ -15,7 +20,28 @@ struct DrawEntity {
 	Transform transform;
 };
 
+enum class GraphicsMode {
+	Window,
+	// Renders offscreen with no window or display, e.g. on a build server. Use `capture_frame` to see the output.
+	// Captured frames are encoded on the thread pool.
+	Headless,
+};
+
+struct GraphicsOptions {
+	GraphicsMode mode;
+	// Window size in screen coordinates, or the image size if headless.
+	// On a HiDPI display the window's framebuffer has more pixels than this; rendering uses the framebuffer's size.
+	u32 width;
+	u32 height;
+	// Fraction of the screen's resolution to render material IDs at. Must be in (0, 1].
+	// The dot pass reads material IDs to decide which parts of dots are hidden, so lower is cheaper but gives blockier edges where dots meet.
+	float material_id_scale;
+};
+const GraphicsOptions DEFAULT_GRAPHICS_OPTIONS { GraphicsMode::Window, 1024, 1024, 1.0f };
+
 struct GraphicsImpl;
+struct GLFrameStats;
+class RenderProfiler;
 
 class Graphics {
 	GraphicsImpl* _impl;
@@ -23,8 +49,22 @@ class Graphics {
 	Graphics(const Graphics& other) = delete;
 	inline Graphics(GraphicsImpl* impl) : _impl{impl} {}
 public:
-	static Graphics start(Slice<Model> models, const std::string& cwd);
+	// `models` and `renderables` are indexed by ModelKind.
+	static Graphics start(Slice<Model> models, Slice<RenderableModel> renderables, const std::string& cwd, const GraphicsOptions& options, ThreadPool& thread_pool);
 	bool window_should_close();
-	void render(Slice<DrawEntity> to_draw);
+	void render(const Camera& camera, Slice<DrawEntity> to_draw);
+	// Resizes the window, or the headless image. (A window the user resizes is handled automatically.)
+	void set_size(u32 width, u32 height);
+	void set_material_id_scale(float scale);
+	// Counts from the most recent `render`. Include gl_types.h to read them.
+	const GLFrameStats& last_frame_stats() const;
+	// Totals of those over every `render` so far.
+	void print_gl_stats(std::ostream& out) const;
+	// Per-pass GPU and CPU times. Include RenderProfiler.h to use it.
+	RenderProfiler& profiler();
+	// Headless only. Saves the last rendered frame as a PNG.
+	// Readback and encoding are asynchronous, so the file may not be written until `finish_captures`.
+	void capture_frame(const std::string& file_name, const PngOptions& png_options);
+	void finish_captures();
 	~Graphics();
 };
@@ -0,0 +1,181 @@
+#include "./RenderProfiler.h"
+
+#include <fstream>
+#include <iomanip> // setw, setprecision
+#include <ostream>
+
+#include "../util/assert.h"
+
+namespace {
+	// No pass takes a second. llvmpipe has given one query's first result as about 7e12 ns.
+	const u64 MAX_PLAUSIBLE_NS = 1000000000;
+
+	u32 render_pass_to_u32(RenderPass pass) {
+		return static_cast<u32>(pass);
+	}
+
+	double ns_to_ms(u64 ns) {
+		return static_cast<double>(ns) / 1e6;
+	}
+
+	double ns_to_us(u64 ns) {
+		return static_cast<double>(ns) / 1e3;
+	}
+
+	void print_histogram(std::ostream& out, const RollingHistogram& h) {
+		out << ' ' << std::setw(9) << ns_to_ms(h.percentile(0.5))
+			<< ' ' << std::setw(9) << ns_to_ms(h.percentile(0.95))
+			<< ' ' << std::setw(9) << ns_to_ms(h.max());
+	}
+}
+
+const char* render_pass_name(RenderPass pass) {
+	switch (pass) {
+		case RenderPass::Upload: return "upload";
+		case RenderPass::Tri: return "tri";
+		case RenderPass::Neighbors: return "neighbors";
+		case RenderPass::Dot: return "dot";
+		case RenderPass::Debug: return "debug";
+		case RenderPass::Swap: return "swap";
+		case RenderPass::Capture: return "capture";
+	}
+}
+
+RenderProfiler::RenderProfiler()
+	: frames{}, n_frames{0}, epoch{std::chrono::steady_clock::now()}, in_pass{false}, current_pass{RenderPass::Upload}, current_pass_start{},
+	stats{}, n_dropped{0}, n_rejected{0}, tracing{false}, trace{} {
+	for (Frame& frame : frames)
+		glGenQueries(N_RENDER_PASSES, frame.queries);
+}
+
+RenderProfiler RenderProfiler::create() {
+	return RenderProfiler {};
+}
+
+RenderProfiler::Frame& RenderProfiler::current_frame() {
+	check(n_frames != 0);
+	return frames[(n_frames - 1) % N_QUERY_FRAMES];
+}
+
+u64 RenderProfiler::now_ns() const {
+	return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+}
+
+void RenderProfiler::collect(Frame& frame, bool wait) {
+	for (u32 i = 0; i != N_RENDER_PASSES; ++i) {
+		if (!frame.used[i])
+			continue;
+		frame.used[i] = false;
+
+		if (!wait) {
+			GLuint available;
+			glGetQueryObjectuiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available == GL_FALSE) {
+				++n_dropped;
+				continue;
+			}
+		}
+		GLuint64 ns;
+		glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &ns);
+		if (ns > MAX_PLAUSIBLE_NS) {
+			++n_rejected;
+			continue;
+		}
+		stats[i].gpu_ns.add(ns);
+		if (tracing)
+			trace.push_back(TraceEvent { RenderPass(i), /*gpu*/ true, frame.index, frame.cpu_start_ns[i], ns });
+	}
+}
+
+void RenderProfiler::begin_frame() {
+	check(!in_pass);
+	Frame& frame = frames[n_frames % N_QUERY_FRAMES];
+	// Results from N_QUERY_FRAMES frames ago. The queries are about to be reused.
+	collect(frame, /*wait*/ false);
+	frame.index = n_frames;
+	++n_frames;
+}
+
+void RenderProfiler::begin(RenderPass pass) {
+	check(!in_pass);
+	Frame& frame = current_frame();
+	u32 i = render_pass_to_u32(pass);
+	check(!frame.used[i]);
+	frame.used[i] = true;
+	in_pass = true;
+	current_pass = pass;
+	current_pass_start = std::chrono::steady_clock::now();
+	frame.cpu_start_ns[i] = now_ns();
+	glBeginQuery(GL_TIME_ELAPSED, frame.queries[i]);
+}
+
+void RenderProfiler::end() {
+	check(in_pass);
+	glEndQuery(GL_TIME_ELAPSED);
+	in_pass = false;
+	u64 ns = static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - current_pass_start).count());
+	u32 i = render_pass_to_u32(current_pass);
+	stats[i].cpu_ns.add(ns);
+	if (tracing)
+		trace.push_back(TraceEvent { current_pass, /*gpu*/ false, current_frame().index, current_frame().cpu_start_ns[i], ns });
+}
+
+const RenderProfiler::PassStats& RenderProfiler::pass_stats(RenderPass pass) const {
+	return stats[render_pass_to_u32(pass)];
+}
+
+void RenderProfiler::set_tracing(bool on) {
+	tracing = on;
+}
+
+void RenderProfiler::finish() {
+	check(!in_pass);
+	// Oldest first, so the trace stays in order.
+	for (u32 i = 0; i != N_QUERY_FRAMES; ++i)
+		collect(frames[(n_frames + i) % N_QUERY_FRAMES], /*wait*/ true);
+}
+
+void RenderProfiler::print(std::ostream& out) const {
+	std::ios::fmtflags old_flags = out.flags();
+	out << std::fixed << std::setprecision(3);
+	out << std::setw(10) << "ms";
+	for (const char* column : { "gpu p50", "p95", "max", "cpu p50", "p95", "max" })
+		out << ' ' << std::setw(9) << column;
+	out << std::endl;
+	for (u32 i = 0; i != N_RENDER_PASSES; ++i) {
+		const PassStats& s = stats[i];
+		if (s.cpu_ns.size() == 0)
+			continue;
+		out << std::setw(10) << render_pass_name(RenderPass(i));
+		print_histogram(out, s.gpu_ns);
+		print_histogram(out, s.cpu_ns);
+		out << std::endl;
+	}
+	if (n_dropped != 0)
+		out << n_dropped << " GPU timings were dropped because they weren't ready in time." << std::endl;
+	if (n_rejected != 0)
+		out << n_rejected << " GPU timings were rejected as over a second." << std::endl;
+	out.flags(old_flags);
+}
+
+void RenderProfiler::write_trace(const std::string& file_name) const {
+	std::ofstream out { file_name };
+	check(out.good());
+	out << std::fixed << std::setprecision(3);
+	// Thread ids are just track names here.
+	out << "{\"traceEvents\":[" << std::endl;
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}}," << std::endl;
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+	for (const TraceEvent& e : trace) {
+		out << "," << std::endl
+			<< "{\"name\":\"" << render_pass_name(e.pass) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << (e.gpu ? 1 : 0)
+			<< ",\"ts\":" << ns_to_us(e.start_ns) << ",\"dur\":" << ns_to_us(e.duration_ns)
+			<< ",\"args\":{\"frame\":" << e.frame << "}}";
+	}
+	out << std::endl << "]}" << std::endl;
+}
+
+void RenderProfiler::free() {
+	for (Frame& frame : frames)
+		glDeleteQueries(N_RENDER_PASSES, frame.queries);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "../util/RollingHistogram.h"
+#include "./gl_types.h"
+#include "./StreamBuffer.h" // N_FRAMES_IN_FLIGHT
+
+// Each may happen at most once per frame.
+enum class RenderPass {
+	Upload, // Instances and frame constants
+	Tri, // Material IDs
+	Neighbors,
+	Dot,
+	Debug,
+	Swap,
+	Capture, // Headless only; the read into a PBO.
+};
+const u32 N_RENDER_PASSES = 7;
+const char* render_pass_name(RenderPass pass);
+
+/**
+ * Times each pass of a frame on the GPU (with GL_TIME_ELAPSED queries) and on the CPU (the time to issue it).
+ * Query results are read N_QUERY_FRAMES frames later, and only if the GPU has them ready; otherwise they're dropped.
+ * So this never waits for the GPU.
+ */
+class RenderProfiler {
+public:
+	struct PassStats {
+		RollingHistogram gpu_ns;
+		RollingHistogram cpu_ns;
+	};
+
+private:
+	static constexpr u32 N_QUERY_FRAMES = N_FRAMES_IN_FLIGHT + 1;
+
+	struct Frame {
+		u32 index;
+		GLuint queries[N_RENDER_PASSES];
+		bool used[N_RENDER_PASSES];
+		// When the CPU started issuing each pass. The GPU event goes here in the trace, since GL_TIME_ELAPSED doesn't say when it started.
+		u64 cpu_start_ns[N_RENDER_PASSES];
+	};
+
+	struct TraceEvent {
+		RenderPass pass;
+		bool gpu;
+		u32 frame;
+		u64 start_ns;
+		u64 duration_ns;
+	};
+
+	Frame frames[N_QUERY_FRAMES];
+	u32 n_frames; // Number of `begin_frame` calls
+	std::chrono::steady_clock::time_point epoch;
+	bool in_pass;
+	RenderPass current_pass;
+	std::chrono::steady_clock::time_point current_pass_start;
+	PassStats stats[N_RENDER_PASSES];
+	u32 n_dropped; // Query results that weren't ready in time.
+	u32 n_rejected; // Query results too long to be real.
+	bool tracing;
+	std::vector<TraceEvent> trace;
+
+	RenderProfiler();
+	Frame& current_frame();
+	u64 now_ns() const;
+	// Reads the frame's query results. If `wait`, waits for them; else drops ones that aren't ready.
+	void collect(Frame& frame, bool wait);
+
+public:
+	static RenderProfiler create();
+
+	void begin_frame();
+	void begin(RenderPass pass);
+	void end();
+
+	const PassStats& pass_stats(RenderPass pass) const;
+	// Tracing keeps every event, so only turn it on for bounded runs.
+	void set_tracing(bool on);
+	// Waits for outstanding queries, so call when done rendering.
+	void finish();
+	// A table of percentiles per pass.
+	void print(std::ostream& out) const;
+	// Chrome trace event format; open in chrome://tracing or Perfetto.
+	void write_trace(const std::string& file_name) const;
+	void free();
+};
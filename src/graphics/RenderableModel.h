@@ -1,14 +1,16 @@
 #pragma once
 
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 
 #include "../util/DynArray.h"
+#include "../util/IndexBuffer.h"
 
-// Must be kept in sync with `dot.vert`.
+// Must be kept in sync with `Material` in `dot.vert` and `debug.frag`, which use the std140 layout.
 struct Material {
-	glm::vec3 diffuse;
-	glm::vec3 specular;
-} __attribute__((packed));
+	glm::vec4 diffuse; // w is unused
+	glm::vec4 specular; // w is unused
+};
 
 struct VertexAttributesTri {
 	glm::vec3 a_position;
@@ -21,9 +23,16 @@ struct VertexAttributesDotOrDebug {
 	u32 a_material_id;
 } __attribute__((packed));
 
+// A triangle list: each vertex appears once and triangles refer to it by index.
+template <typename TVertexAttributes>
+struct IndexedVertices {
+	DynArray<TVertexAttributes> vertices;
+	IndexBuffer indices;
+};
+
 struct RenderableModel {
-	DynArray<VertexAttributesTri> tris;
+	IndexedVertices<VertexAttributesTri> tris;
 	DynArray<VertexAttributesDotOrDebug> dots;
 	//TODO:PERF #if DEBUG
-	DynArray<VertexAttributesDotOrDebug> debug; // These are triangles, not dots. Unlike `tris` this includes lighting information and not just material_id.
+	IndexedVertices<VertexAttributesDotOrDebug> debug; // Unlike `tris` this includes lighting information and not just material_id.
 };
@@ -0,0 +1,91 @@
+#include "./StreamBuffer.h"
+
+#include <algorithm> // max
+#include <chrono>
+
+#include "../util/assert.h"
+
+namespace {
+	// Offsets of each region must satisfy any alignment a binding might need (e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT).
+	const size_t REGION_ALIGNMENT = 256;
+
+	const GLbitfield MAP_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	size_t round_up(size_t size, size_t multiple) {
+		return (size + multiple - 1) / multiple * multiple;
+	}
+}
+
+StreamBuffer::StreamBuffer(GLenum _target, size_t _region_size) : target{_target}, id{0}, mapped{nullptr}, region_size{round_up(_region_size, REGION_ALIGNMENT)}, region{0}, fences{} {
+	// glBufferStorage is GL 4.4.
+	check(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+
+	GLuint buffer_id;
+	glGenBuffers(1, &buffer_id);
+	check(buffer_id != 0);
+	id = gluint_to_u32(buffer_id);
+	glBindBuffer(target, id);
+	size_t size = region_size * N_FRAMES_IN_FLIGHT;
+	glBufferStorage(target, static_cast<GLsizeiptr>(size), nullptr, MAP_FLAGS);
+	mapped = static_cast<char*>(glMapBufferRange(target, 0, static_cast<GLsizeiptr>(size), MAP_FLAGS));
+	check(mapped != nullptr);
+}
+
+StreamBuffer StreamBuffer::create(GLenum target, size_t region_size) {
+	return StreamBuffer { target, region_size };
+}
+
+void StreamBuffer::wait_for_region(GLState& gl, u32 r) {
+	GLsync fence = fences[r];
+	if (fence == nullptr)
+		return;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (true) {
+		GLenum res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, /*timeout ns*/ 1000000);
+		check(res != GL_WAIT_FAILED);
+		if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED)
+			break;
+	}
+	gl.add_fence_wait_ns(u64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+
+	glDeleteSync(fence);
+	fences[r] = nullptr;
+}
+
+void StreamBuffer::grow(GLState& gl, size_t min_region_size) {
+	for (u32 r = 0; r != N_FRAMES_IN_FLIGHT; ++r)
+		wait_for_region(gl, r);
+	free();
+	u32 old_region = region;
+	*this = StreamBuffer { target, std::max(min_region_size, region_size * 2) };
+	region = old_region;
+	// The new buffer is bound directly and may reuse the old id.
+	gl.forget();
+}
+
+MutableSlice<char> StreamBuffer::begin_frame_bytes(GLState& gl, size_t size) {
+	region = (region + 1) % N_FRAMES_IN_FLIGHT;
+	if (size > region_size)
+		grow(gl, size);
+	else
+		wait_for_region(gl, region);
+	return { mapped + region_offset(), ulong_to_u32(size) };
+}
+
+void StreamBuffer::end_frame() {
+	check(fences[region] == nullptr);
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::free() {
+	for (GLsync& fence : fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	glBindBuffer(target, id);
+	glUnmapBuffer(target);
+	glDeleteBuffers(1, &id);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef> // size_t
+
+#include "../util/MutableSlice.h"
+#include "./gl_types.h"
+
+// Frames the CPU may be ahead of the GPU by.
+const u32 N_FRAMES_IN_FLIGHT = 3;
+
+/**
+ * A buffer rewritten every frame, e.g. per-instance data.
+ * It's persistently mapped and split into one region per frame in flight.
+ * A region is only rewritten once a fence says the GPU is done with the frame that last used it,
+ * so writing frame N doesn't wait for the GPU to finish reading frame N - 1.
+ */
+class StreamBuffer {
+	GLenum target;
+	u32 id;
+	char* mapped;
+	size_t region_size;
+	u32 region; // Index of the region being written this frame.
+	GLsync fences[N_FRAMES_IN_FLIGHT]; // nullptr if the region's last use is known to be finished.
+
+	StreamBuffer(GLenum _target, size_t _region_size);
+	void wait_for_region(GLState& gl, u32 r);
+	void grow(GLState& gl, size_t min_region_size);
+	MutableSlice<char> begin_frame_bytes(GLState& gl, size_t size);
+
+public:
+	static StreamBuffer create(GLenum target, size_t region_size);
+
+	// Returns this frame's region, waiting if the GPU might still be reading it.
+	// Call `end_frame` after the last draw that reads it.
+	// This may reallocate the buffer (and forget `gl`'s state) if it is too small.
+	template <typename T>
+	MutableSlice<T> begin_frame(GLState& gl, u32 n) {
+		MutableSlice<char> bytes = begin_frame_bytes(gl, n * sizeof(T));
+		return { static_cast<T*>(static_cast<void*>(bytes.begin())), n };
+	}
+
+	// Byte offset of this frame's region in the buffer.
+	inline size_t region_offset() const {
+		return region * region_size;
+	}
+
+	inline void bind(GLState& gl) const {
+		gl.bind_buffer(target, id);
+	}
+
+	void end_frame();
+	void free();
+};
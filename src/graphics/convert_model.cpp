@@ -1,46 +1,46 @@
 #include "convert_model.h"
 
+#include <algorithm> // min
 #include <glm/vec3.hpp>
 #include <glm/gtc/matrix_transform.hpp> // cross
 #include <random>
 
+#include "../model/adjacency.h"
+#include "./index_vertices.h"
+#include "./sample_strokes.h"
+
 namespace {
 	struct Stroke {
 		glm::vec3 pos;
 		glm::vec3 color;
 	};
 
-	struct Triangle {
-		glm::vec3 p0;
-		glm::vec3 p1;
-		glm::vec3 p2;
-	};
-
-	struct Normals {
-		glm::vec3 n0;
-		glm::vec3 n1;
-		glm::vec3 n2;
-	};
-
-	Triangle face_vertices(const Face& face, const Model& m) {
+	template <typename Index>
+	Triangle face_vertices(const Face<Index>& face, const Model& m) {
 		return Triangle { m.vertices[face.vertex_0], m.vertices[face.vertex_1], m.vertices[face.vertex_2] };
 	};
 
-	Normals face_normals(const Face& face, const Model& m) {
+	template <typename Index>
+	Normals face_normals(const Face<Index>& face, const Model& m) {
 		return Normals { m.normals[face.normal_0], m.normals[face.normal_1], m.normals[face.normal_2] };
 	}
 
 	double triangle_area(const Triangle& t) {
 		glm::dvec3 va = t.p1 - t.p0;
 		glm::dvec3 vb = t.p2 - t.p0;
-		return glm::cross(va, vb).length() * 0.5;
+		return glm::length(glm::cross(va, vb)) * 0.5;
 	}
 
-	double compute_total_area(const Model& m) {
-		double total = 0;
-		for (const Face& face : m.faces)
-			total += triangle_area(face_vertices(face, m));
-		return total;
+	const u32 FACES_PER_CHUNK = 4096;
+
+	// Calls cb(begin, end) for consecutive ranges of faces, in parallel.
+	template <typename Cb>
+	void for_each_chunk(ThreadPool& thread_pool, u32 n_faces, Cb cb) {
+		u32 n_chunks = (n_faces + FACES_PER_CHUNK - 1) / FACES_PER_CHUNK;
+		thread_pool.parallel_for(n_chunks, [&](u32 chunk) {
+			u32 begin = chunk * FACES_PER_CHUNK;
+			cb(begin, std::min(begin + FACES_PER_CHUNK, n_faces));
+		});
 	}
 
 	u32 round_to_u32(double d) {
@@ -48,33 +48,8 @@ namespace {
 		return static_cast<u32>(round(d));
 	}
 
-	float float_sqrt(float f) {
-		return static_cast<float>(sqrt(static_cast<double>(f)));
-	}
-
 	using Random = std::mt19937_64;
 
-	bool about_equal(float a, float b) {
-		return (a - 0.01f) < b && (a + 0.01f) > b;
-	}
-
-	struct PointNormal { glm::vec3 point; glm::vec3 normal; };
-	// Uses barycentric coordinates
-	PointNormal random_point_normal_in_triangle(const Triangle& tri, const Normals& normals, Random& rand) {
-		std::uniform_real_distribution<> dis(0.0, 1.0);
-		float rand0 = static_cast<float>(dis(rand)); //TODO:BETTER random
-		float rand1 = static_cast<float>(dis(rand));
-		float alpha = 1 - float_sqrt(rand0);
-		float beta = rand1 * (1 - alpha);
-		float gamma = 1 - alpha - beta;
-
-		check(about_equal(alpha + beta + gamma, 1.0f));
-
-		glm::vec3 point = tri.p0 * alpha + tri.p1 * beta + tri.p2 * gamma;
-		glm::vec3 normal = normals.n0 * alpha + normals.n1 * beta + normals.n2 * gamma;
-		return { point, normal };
-	}
-
 	float rand_range(float min, float max, Random& rand) {
 		std::uniform_real_distribution<> dis(static_cast<double>(min), static_cast<double>(max));
 		return static_cast<float>(dis(rand));
@@ -90,45 +65,70 @@ namespace {
 		return Color { fluctuate(c.r), fluctuate(c.g), fluctuate(c.b) };
 	}
 
-	DynArray<VertexAttributesDotOrDebug> gen_dots(const Model& m, Random& rand) {
-		double total_area = compute_total_area(m);
-
-		u32 n_strokes = 500; // TODO: configurable
+	// Entry i is the index of face i's first stroke, and the last entry is the total number of strokes.
+	// Rounding the running total (rather than each face's own share) means small faces still get their fair share overall.
+	template <typename Index>
+	DynArray<u32> get_stroke_offsets(const Model& m, Slice<Face<Index>> faces, double strokes_per_unit_area, ThreadPool& thread_pool) {
+		DynArray<double> areas = DynArray<double>::uninitialized(faces.size());
+		for_each_chunk(thread_pool, faces.size(), [&](u32 begin, u32 end) {
+			for (u32 i = begin; i != end; ++i)
+				areas[i] = triangle_area(face_vertices(faces[i], m));
+		});
+
+		DynArray<u32> offsets = DynArray<u32>::uninitialized(faces.size() + 1);
+		double total_area = 0;
+		for (u32 i = 0; i != faces.size(); ++i) {
+			offsets[i] = round_to_u32(total_area * strokes_per_unit_area);
+			total_area += areas[i];
+		}
+		offsets[faces.size()] = round_to_u32(total_area * strokes_per_unit_area);
+		return offsets;
+	}
 
-		double density = n_strokes / total_area;
+	template <typename Index>
+	Normals face_smooth_normals(const Face<Index>& face, const DynArray<glm::vec3>& smooth_normals) {
+		return Normals { smooth_normals[face.vertex_0], smooth_normals[face.vertex_1], smooth_normals[face.vertex_2] };
+	}
 
-		double vertices_owed = 0;
+	template <typename Index>
+	DynArray<VertexAttributesDotOrDebug> gen_dots(
+		const Model& m,
+		Slice<Face<Index>> faces,
+		const DynArray<glm::vec3>& smooth_normals,
+		const ConvertOptions& options,
+		ThreadPool& thread_pool
+	) {
+		DynArray<u32> offsets = get_stroke_offsets(m, faces, options.strokes_per_unit_area, thread_pool);
+		u32 n_strokes = offsets[faces.size()];
+		if (n_strokes == 0)
+			return {};
 
-		uint out_i = 0;
 		DynArray<VertexAttributesDotOrDebug> out = DynArray<VertexAttributesDotOrDebug>::uninitialized(n_strokes);
-
-		for (const Face& face : m.faces) {
-			Triangle tri = face_vertices(face, m);
-			//TODO: interpolate between vertex normals -- needs adjacent faces
-			Normals normals = face_normals(face, m);
-			const ParsedMaterial& material = m.materials[face.material];
-
-			double area = triangle_area(tri);
-
-			vertices_owed += area * density;
-			uint n_face_points = round_to_u32(vertices_owed);
-			vertices_owed -= n_face_points;
-
-			for (uint i = n_face_points; i != 0; --i) {
-				PointNormal pn = random_point_normal_in_triangle(tri, normals, rand);
-				//Color color = material.kd;//random_color_near(material.kd, rand);
-				out[out_i++] = VertexAttributesDotOrDebug { pn.point, pn.normal, material.id };
+		PhiloxKey key = philox_key(options.seed);
+
+		// Each stroke's random numbers come from its own index, so chunking doesn't affect the output.
+		for_each_chunk(thread_pool, faces.size(), [&](u32 begin, u32 end) {
+			for (u32 face_i = begin; face_i != end; ++face_i) {
+				const Face<Index>& face = faces[face_i];
+				Triangle tri = face_vertices(face, m);
+				Normals normals = face_smooth_normals(face, smooth_normals);
+				const ParsedMaterial& material = m.materials[face.material];
+
+				u32 first_stroke = offsets[face_i];
+				//TODO: random_color_near(material.kd, rand)
+				sample_strokes(tri, normals, material.id, key, first_stroke, MutableSlice<VertexAttributesDotOrDebug> { out.begin() + first_stroke, offsets[face_i + 1] - first_stroke });
 			}
-		}
+		});
 
-		assert(out_i == out.size());
 		return out;
 	}
 
-	DynArray<VertexAttributesTri> get_triangles(const Model& m) {
-		DynArray<VertexAttributesTri> out = DynArray<VertexAttributesTri>::uninitialized(m.faces.size() * 3);
+	// One vertex per face corner. These are welded by index_vertices.
+	template <typename Index>
+	DynArray<VertexAttributesTri> get_triangles(const Model& m, Slice<Face<Index>> faces) {
+		DynArray<VertexAttributesTri> out = DynArray<VertexAttributesTri>::uninitialized(faces.size() * 3);
 		uint i = 0;
-		for (const Face& face : m.faces) {
+		for (const Face<Index>& face : faces) {
 			Triangle tri = face_vertices(face, m);
 			const ParsedMaterial& material = m.materials[face.material];
 			out[i++] = VertexAttributesTri { tri.p0, material.id };
@@ -139,10 +139,11 @@ namespace {
 		return out;
 	};
 
-	DynArray<VertexAttributesDotOrDebug> get_debug(const Model& m) {
-		DynArray<VertexAttributesDotOrDebug> out = DynArray<VertexAttributesDotOrDebug>::uninitialized(m.faces.size() * 3);
+	template <typename Index>
+	DynArray<VertexAttributesDotOrDebug> get_debug(const Model& m, Slice<Face<Index>> faces) {
+		DynArray<VertexAttributesDotOrDebug> out = DynArray<VertexAttributesDotOrDebug>::uninitialized(faces.size() * 3);
 		uint i = 0;
-		for (const Face& face : m.faces) {
+		for (const Face<Index>& face : faces) {
 			Triangle tri = face_vertices(face, m);
 			Normals normals = face_normals(face, m);
 			const ParsedMaterial& material = m.materials[face.material];
@@ -155,7 +156,14 @@ namespace {
 	}
 }
 
-RenderableModel convert_model(const Model& m) {
-	Random rand;
-	return { get_triangles(m), gen_dots(m, rand), get_debug(m) };
+RenderableModel convert_model(const Model& m, const ConvertOptions& options, ThreadPool& thread_pool) {
+	VertexFaceAdjacency adjacency = build_vertex_face_adjacency(m);
+	DynArray<glm::vec3> smooth_normals = compute_smooth_normals(m, adjacency, thread_pool);
+	return m.with_faces([&](auto faces) {
+		return RenderableModel {
+			index_vertices(get_triangles(m, faces).slice()),
+			gen_dots(m, faces, smooth_normals, options, thread_pool),
+			index_vertices(get_debug(m, faces).slice()),
+		};
+	});
 };
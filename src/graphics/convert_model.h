@@ -1,6 +1,15 @@
 #pragma once
 
 #include "../model/Model.h"
+#include "../util/ThreadPool.h"
 #include "./RenderableModel.h"
 
-RenderableModel convert_model(const Model& m);
+struct ConvertOptions {
+	double strokes_per_unit_area;
+	// Strokes depend only on this and the model, not on the number of threads.
+	u64 seed;
+};
+
+const ConvertOptions DEFAULT_CONVERT_OPTIONS { 40.0, 0 };
+
+RenderableModel convert_model(const Model& m, const ConvertOptions& options, ThreadPool& thread_pool);
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <limits>
 
+#include "../util/assert.h"
 #include "../util/int.h"
 
 struct ShaderProgram {
@@ -25,6 +27,21 @@ struct VBO {
 	}
 };
 
+struct IBO {
+	u32 id;
+	u32 n_indices;
+	GLenum index_type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+
+	// Note: this is part of the bound VAO's state.
+	inline void bind() const {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+	}
+
+	inline void free() {
+		glDeleteBuffers(1, &id);
+	}
+};
+
 struct VAO {
 	u32 id;
 	inline void bind() const {
@@ -64,19 +81,29 @@ struct Uniform {
 	u32 id;
 	Uniform() = delete;
 };
+// Model matrices are per-instance attributes, and the view-projection matrix is in the FrameConstants block.
+// Materials are in the Materials block.
 struct TriUniforms {
-	Uniform u_transform;
+	Uniform u_material_base;
 };
 struct DotUniforms {
-	Uniform u_model;
-	Uniform u_transform;
-	Uniform u_materials;
+	Uniform u_material_base;
+	Uniform u_neighbor_ids;
+};
+struct NeighborsUniforms {
 	Uniform u_material_id_texture;
+	Uniform u_viewport_size;
 };
 struct DebugUniforms {
-	Uniform u_model;
-	Uniform u_transform;
-	Uniform u_materials;
+	Uniform u_material_base;
+};
+
+struct UniformBuffer {
+	u32 id;
+
+	inline void free() {
+		glDeleteBuffers(1, &id);
+	}
 };
 
 struct Texture {
@@ -94,12 +121,28 @@ struct VAOInfo {
 	}
 };
 
+// The IBO is bound as part of the VAO, so drawing only needs the VAO bound.
+struct IndexedVAOInfo {
+	VAO vao;
+	VBO vbo;
+	IBO ibo;
+
+	inline void free() {
+		//todo: free vao
+		vbo.free();
+		ibo.free();
+	}
+};
+
 struct FrameBuffer {
 	GLuint id;
 	Texture output_texture;
+	GLuint depth_renderbuffer;
 
 	inline void free() {
 		glDeleteFramebuffers(1, &id);
+		glDeleteTextures(1, &output_texture.id);
+		glDeleteRenderbuffers(1, &depth_renderbuffer);
 	}
 };
 
@@ -127,3 +170,131 @@ inline GLuint glint_to_gluint(GLint i) {
 	check(i >= 0);
 	return static_cast<GLuint>(i);
 }
+
+// Counts for one frame. See GLState.
+struct GLFrameStats {
+	u32 binds; // Binds and enables/disables that reached GL.
+	u32 redundant_binds; // Ones that were dropped because GL already had that state.
+	u32 draw_calls;
+	u64 fence_wait_ns; // Time spent waiting for the GPU to release stream buffer regions. High when GPU bound.
+};
+
+// Remembers what is bound so that rendering doesn't reissue state GL already has.
+// Only the render loop goes through this. Setup code binds things directly, so call `forget` after it.
+// Textures only use unit 0.
+class GLState {
+	static constexpr u32 UNKNOWN = std::numeric_limits<u32>::max();
+
+	u32 program;
+	u32 vao;
+	u32 array_buffer;
+	u32 uniform_buffer;
+	u32 texture_2d;
+	u32 framebuffer;
+	// Indexed by `capability_index`. 0 for disabled, 1 for enabled, or UNKNOWN.
+	u32 capabilities[3];
+
+	GLFrameStats stats;
+
+	static u32 capability_index(GLenum capability) {
+		switch (capability) {
+			case GL_DEPTH_TEST: return 0;
+			case GL_BLEND: return 1;
+			case GL_VERTEX_PROGRAM_POINT_SIZE: return 2;
+			default: unreachable();
+		}
+	}
+
+	u32& buffer_binding(GLenum target) {
+		switch (target) {
+			case GL_ARRAY_BUFFER: return array_buffer;
+			case GL_UNIFORM_BUFFER: return uniform_buffer;
+			default: unreachable();
+		}
+	}
+
+	// Returns true if GL needs to be told.
+	bool change(u32& current, u32 value) {
+		if (current == value) {
+			++stats.redundant_binds;
+			return false;
+		} else {
+			current = value;
+			++stats.binds;
+			return true;
+		}
+	}
+
+public:
+	GLState() : stats{0, 0, 0, 0} {
+		forget();
+	}
+
+	void forget() {
+		program = vao = array_buffer = uniform_buffer = texture_2d = framebuffer = UNKNOWN;
+		for (u32& c : capabilities)
+			c = UNKNOWN;
+	}
+
+	void use(const Shaders& shaders) {
+		if (change(program, shaders.program.id))
+			glUseProgram(program);
+	}
+
+	void bind(const VAO& v) {
+		if (change(vao, v.id))
+			glBindVertexArray(vao);
+	}
+
+	// Only GL_ARRAY_BUFFER and GL_UNIFORM_BUFFER are tracked.
+	// (GL_ELEMENT_ARRAY_BUFFER is part of the VAO.)
+	void bind_buffer(GLenum target, u32 id) {
+		if (change(buffer_binding(target), id))
+			glBindBuffer(target, id);
+	}
+
+	void bind(const UniformBuffer& u) {
+		bind_buffer(GL_UNIFORM_BUFFER, u.id);
+	}
+
+	void bind(const Texture& t) {
+		if (change(texture_2d, t.id))
+			glBindTexture(GL_TEXTURE_2D, texture_2d);
+	}
+
+	// 0 for the default frame buffer.
+	void bind_framebuffer(GLuint id) {
+		if (change(framebuffer, id))
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+
+	void set_enabled(GLenum capability, bool enabled) {
+		if (change(capabilities[capability_index(capability)], enabled ? 1 : 0)) {
+			if (enabled)
+				glEnable(capability);
+			else
+				glDisable(capability);
+		}
+	}
+
+	void draw_elements_instanced(GLenum mode, const IBO& ibo, u32 n_instances) {
+		++stats.draw_calls;
+		glDrawElementsInstanced(mode, u32_to_glsizei(ibo.n_indices), ibo.index_type, nullptr, u32_to_glsizei(n_instances));
+	}
+
+	void draw_arrays_instanced(GLenum mode, u32 n_vertices, u32 n_instances) {
+		++stats.draw_calls;
+		glDrawArraysInstanced(mode, 0, u32_to_glsizei(n_vertices), u32_to_glsizei(n_instances));
+	}
+
+	void add_fence_wait_ns(u64 ns) {
+		stats.fence_wait_ns += ns;
+	}
+
+	// Returns this frame's stats and starts counting the next frame.
+	GLFrameStats end_frame() {
+		GLFrameStats out = stats;
+		stats = GLFrameStats { 0, 0, 0, 0 };
+		return out;
+	}
+};
@@ -0,0 +1,36 @@
+#include "./headless_context.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "../util/assert.h"
+
+HeadlessContext create_headless_context() {
+	// Mesa's surfaceless platform needs neither X nor a GPU device.
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	check(get_platform_display != nullptr);
+	EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	check(display != EGL_NO_DISPLAY);
+	EGLint major, minor;
+	check(eglInitialize(display, &major, &minor) == EGL_TRUE);
+	check(eglBindAPI(EGL_OPENGL_API) == EGL_TRUE);
+
+	// Same version as the window gets. (Compatibility profile, since the shaders are GLSL ES.)
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE,
+	};
+	// No config is needed since we never create a surface.
+	EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+	check(context != EGL_NO_CONTEXT);
+	check(eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_TRUE);
+	return HeadlessContext { display, context };
+}
+
+void destroy_headless_context(HeadlessContext& context) {
+	eglMakeCurrent(context.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(context.display, context.context);
+	eglTerminate(context.display);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// An OpenGL context with no window, for machines with no display or GPU (e.g. build servers using Mesa's llvmpipe).
+// There's no default framebuffer, so everything must render to framebuffer objects.
+struct HeadlessContext {
+	void* display; // EGLDisplay
+	void* context; // EGLContext
+};
+
+// Also makes it current on this thread.
+HeadlessContext create_headless_context();
+void destroy_headless_context(HeadlessContext& context);
@@ -0,0 +1,87 @@
+#include "./index_vertices.h"
+
+#include <cstring> // memcmp
+#include <limits>
+
+#include "../util/hash.h"
+#include "./vertex_cache.h"
+
+namespace {
+	const u32 NONE = std::numeric_limits<u32>::max();
+
+	template <typename T>
+	Slice<char> bytes_of(const T& value) {
+		return Slice<char> { reinterpret_cast<const char*>(&value), sizeof(T) };
+	}
+
+	u32 power_of_two_at_least(u32 n) {
+		u32 out = 1;
+		while (out < n) out = safe_mul(out, 2);
+		return out;
+	}
+
+	struct Welded {
+		DynArray<u32> unique_corners; // For each unique vertex, the first corner that had it. Only the first n_unique are used.
+		u32 n_unique;
+		DynArray<u32> indices; // For each corner, its index into unique_corners.
+	};
+
+	// Vertex attributes are packed, so comparing bytes compares every field.
+	// (This won't merge 0.0 with -0.0, which only costs a duplicate vertex.)
+	template <typename T>
+	Welded weld(Slice<T> corners) {
+		// Open addressing with linear probing. At most half full, so probes stay short.
+		u32 mask = power_of_two_at_least(safe_mul(corners.size(), 2)) - 1;
+		DynArray<u32> table = DynArray<u32>::uninitialized(mask + 1);
+		for (u32& slot : table) slot = NONE;
+
+		DynArray<u32> unique_corners = DynArray<u32>::uninitialized(corners.size());
+		u32 n_unique = 0;
+		DynArray<u32> indices = DynArray<u32>::uninitialized(corners.size());
+		for (u32 c = 0; c != corners.size(); ++c) {
+			const T& corner = corners[c];
+			u32 slot = static_cast<u32>(hash_bytes(bytes_of(corner))) & mask;
+			while (table[slot] != NONE && memcmp(&corners[unique_corners[table[slot]]], &corner, sizeof(T)) != 0)
+				slot = (slot + 1) & mask;
+			if (table[slot] == NONE) {
+				table[slot] = n_unique;
+				unique_corners[n_unique++] = c;
+			}
+			indices[c] = table[slot];
+		}
+
+		return Welded { std::move(unique_corners), n_unique, std::move(indices) };
+	}
+
+	template <typename T>
+	IndexedVertices<T> index(Slice<T> corners) {
+		Welded welded = weld(corners);
+		u32 n_unique = welded.n_unique;
+		DynArray<u32> indices = optimize_vertex_cache(welded.indices.slice(), n_unique);
+
+		// Renumber vertices in the order the reordered triangles first use them, so vertex fetches walk forward through the buffer.
+		DynArray<u32> renumbered = DynArray<u32>::uninitialized(n_unique);
+		for (u32& r : renumbered) r = NONE;
+		DynArray<T> vertices = DynArray<T>::uninitialized(n_unique);
+		u32 n_renumbered = 0;
+		for (u32& i : indices) {
+			if (renumbered[i] == NONE) {
+				renumbered[i] = n_renumbered;
+				vertices[n_renumbered] = corners[welded.unique_corners[i]];
+				++n_renumbered;
+			}
+			i = renumbered[i];
+		}
+		check(n_renumbered == n_unique);
+
+		return IndexedVertices<T> { std::move(vertices), to_narrowest_index_buffer(std::move(indices), n_unique) };
+	}
+}
+
+IndexedVertices<VertexAttributesTri> index_vertices(Slice<VertexAttributesTri> corners) {
+	return index(corners);
+}
+
+IndexedVertices<VertexAttributesDotOrDebug> index_vertices(Slice<VertexAttributesDotOrDebug> corners) {
+	return index(corners);
+}
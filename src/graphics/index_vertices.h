@@ -0,0 +1,8 @@
+#pragma once
+
+#include "./RenderableModel.h"
+
+// `corners` is a triangle list with 3 entries per triangle.
+// Merges byte-identical vertices, then orders triangles for the vertex cache and vertices by first use.
+IndexedVertices<VertexAttributesTri> index_vertices(Slice<VertexAttributesTri> corners);
+IndexedVertices<VertexAttributesDotOrDebug> index_vertices(Slice<VertexAttributesDotOrDebug> corners);
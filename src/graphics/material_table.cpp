@@ -0,0 +1,28 @@
+#include "./material_table.h"
+
+#include "../util/assert.h"
+
+MaterialTable build_material_table(Slice<Model> models) {
+	check(models.size() == N_MODELS);
+
+	MaterialTable out { {}, {} };
+	u32 n_materials = 0;
+	for (u32 i = 0; i != N_MODELS; ++i) {
+		out.bases[i] = n_materials;
+		n_materials += models[i].materials.size();
+	}
+	check(n_materials <= MAX_MATERIALS);
+	if (n_materials == 0)
+		return out;
+
+	out.materials = DynArray<Material>::uninitialized(n_materials);
+	for (u32 model_i = 0; model_i != N_MODELS; ++model_i) {
+		Slice<ParsedMaterial> parsed = models[model_i].materials.slice();
+		for (u32 i = 0; i != parsed.size(); ++i) {
+			const ParsedMaterial& m = parsed[i];
+			assert(m.id == i + 1);
+			out.materials[out.bases[model_i] + i] = Material { glm::vec4 { m.kd.vec3(), 0.0f }, glm::vec4 { m.ks.vec3(), 0.0f } };
+		}
+	}
+	return out;
+}
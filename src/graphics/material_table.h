@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../model/Model.h"
+#include "../model/ModelKind.h"
+#include "../util/FixedArray.h"
+#include "./RenderableModel.h"
+
+// Must match MAX_MATERIALS in the shaders.
+// The array is in a uniform block, and GL only promises 16KB for those.
+const u32 MAX_MATERIALS = 16384 / sizeof(Material);
+
+// Every model's materials, so that material ids are unique across models.
+// Vertex data stores each model's own material id (starting at 1);
+// the shaders add the model's `base` to get its global id, which is an index into `materials` + 1.
+struct MaterialTable {
+	DynArray<Material> materials;
+	FixedArray<N_MODELS, u32> bases;
+};
+
+// `models` is indexed by ModelKind.
+MaterialTable build_material_table(Slice<Model> models);
@@ -4,4 +4,16 @@
 #include "../util/Matrix.h"
 
 Matrix<uint32_t> png_texture_load(const char* file_name);
-void write_png(u32 width, u32 height, Slice<u8> bitmap, const char* file_name);
+enum class RowOrder {
+	TopDown,
+	BottomUp, // As OpenGL reads them
+};
+
+struct PngOptions {
+	// zlib's 0 (no compression) to 9 (smallest). 1 is much faster than the default of 6, and usually not much bigger.
+	int compression_level;
+};
+const PngOptions DEFAULT_PNG_OPTIONS { 6 };
+
+// `rgb` has 3 bytes per pixel and no padding between rows. It's given to libpng without copying.
+void write_png(u32 width, u32 height, Slice<u8> rgb, RowOrder row_order, const PngOptions& options, const char* file_name);
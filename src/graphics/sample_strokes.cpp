@@ -0,0 +1,267 @@
+#include "./sample_strokes.h"
+
+#include <chrono>
+#include <cmath> // fabsf, sqrt, sqrtf
+#include <cstring> // memcmp
+#include <iostream>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+/*
+Every kernel must do exactly the same float operations in the same order as sample_stroke, so that a model bakes the same on any machine.
+In particular nothing here may be contracted into an FMA, which is why the AVX2 kernel doesn't enable "fma".
+*/
+
+namespace {
+	const float UNIT_FLOAT_SCALE = 1.0f / 16777216.0f; // See u32_to_unit_float
+
+	// Same constants as philox4x32_10
+	const u32 PHILOX_M0 = 0xD2511F53;
+	const u32 PHILOX_M1 = 0xCD9E8D57;
+	const u32 PHILOX_W0 = 0x9E3779B9;
+	const u32 PHILOX_W1 = 0xBB67AE85;
+
+	// The reference implementation, and the tail of each SIMD kernel.
+	VertexAttributesDotOrDebug sample_stroke(const Triangle& tri, const Normals& normals, u32 material_id, PhiloxKey key, u32 stroke_i) {
+		PhiloxBlock rand = philox4x32_10(PhiloxBlock { stroke_i, 0, 0, 0 }, key);
+		// Barycentric coordinates. Taking the square root makes the distribution uniform over the triangle's area.
+		float alpha = 1.0f - sqrtf(u32_to_unit_float(rand.x0));
+		float beta = u32_to_unit_float(rand.x1) * (1.0f - alpha);
+		float gamma = 1.0f - alpha - beta;
+		return VertexAttributesDotOrDebug {
+			tri.p0 * alpha + tri.p1 * beta + tri.p2 * gamma,
+			normals.n0 * alpha + normals.n1 * beta + normals.n2 * gamma,
+			material_id,
+		};
+	}
+
+	void sample_strokes_scalar(const Triangle& tri, const Normals& normals, u32 material_id, PhiloxKey key, u32 first_stroke, MutableSlice<VertexAttributesDotOrDebug> out, u32 begin) {
+		for (u32 i = begin; i != out.size(); ++i)
+			out[i] = sample_stroke(tri, normals, material_id, key, first_stroke + i);
+	}
+
+	// Lanes of a SIMD kernel are stored to these and then interleaved into the output.
+	template <u32 N>
+	struct Lanes {
+		float px[N], py[N], pz[N];
+		float nx[N], ny[N], nz[N];
+	};
+
+	template <u32 N>
+	void write_lanes(const Lanes<N>& lanes, u32 material_id, VertexAttributesDotOrDebug* out) {
+		for (u32 l = 0; l != N; ++l)
+			out[l] = VertexAttributesDotOrDebug {
+				glm::vec3 { lanes.px[l], lanes.py[l], lanes.pz[l] },
+				glm::vec3 { lanes.nx[l], lanes.ny[l], lanes.nz[l] },
+				material_id,
+			};
+	}
+
+#ifdef __x86_64__
+	// SSE2 is part of x86-64, so this needs no runtime check.
+
+	struct MulHiLo128 { __m128i hi; __m128i lo; };
+	// 32x32->64 multiply of each lane. _mm_mul_epu32 only does the even lanes, so do the odd lanes separately and interleave.
+	inline MulHiLo128 mul_hi_lo(__m128i a, __m128i m) {
+		__m128i even = _mm_shuffle_epi32(_mm_mul_epu32(a, m), _MM_SHUFFLE(3, 1, 2, 0)); // lo0, lo2, hi0, hi2
+		__m128i odd = _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(a, 32), m), _MM_SHUFFLE(3, 1, 2, 0)); // lo1, lo3, hi1, hi3
+		return MulHiLo128 { _mm_unpackhi_epi32(even, odd), _mm_unpacklo_epi32(even, odd) };
+	}
+
+	inline __m128 unit_float(__m128i u) {
+		return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(u, 8)), _mm_set1_ps(UNIT_FLOAT_SCALE));
+	}
+
+	inline __m128 interpolate(float a, float b, float c, __m128 alpha, __m128 beta, __m128 gamma) {
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a), alpha), _mm_mul_ps(_mm_set1_ps(b), beta)), _mm_mul_ps(_mm_set1_ps(c), gamma));
+	}
+
+	void sample_strokes_sse2(const Triangle& tri, const Normals& normals, u32 material_id, PhiloxKey key, u32 first_stroke, MutableSlice<VertexAttributesDotOrDebug> out) {
+		const u32 N = 4;
+		const __m128i m0 = _mm_set1_epi32(static_cast<int>(PHILOX_M0));
+		const __m128i m1 = _mm_set1_epi32(static_cast<int>(PHILOX_M1));
+		const __m128 one = _mm_set1_ps(1.0f);
+		u32 i = 0;
+		for (; i + N <= out.size(); i += N) {
+			u32 ctr = first_stroke + i;
+			__m128i x0 = _mm_setr_epi32(static_cast<int>(ctr), static_cast<int>(ctr + 1), static_cast<int>(ctr + 2), static_cast<int>(ctr + 3));
+			__m128i x1 = _mm_setzero_si128();
+			__m128i x2 = _mm_setzero_si128();
+			__m128i x3 = _mm_setzero_si128();
+			PhiloxKey k = key;
+			for (u32 round = 0; round != 10; ++round) {
+				MulHiLo128 p0 = mul_hi_lo(x0, m0);
+				MulHiLo128 p1 = mul_hi_lo(x2, m1);
+				x0 = _mm_xor_si128(_mm_xor_si128(p1.hi, x1), _mm_set1_epi32(static_cast<int>(k.k0)));
+				x1 = p1.lo;
+				x2 = _mm_xor_si128(_mm_xor_si128(p0.hi, x3), _mm_set1_epi32(static_cast<int>(k.k1)));
+				x3 = p0.lo;
+				k.k0 += PHILOX_W0;
+				k.k1 += PHILOX_W1;
+			}
+
+			__m128 alpha = _mm_sub_ps(one, _mm_sqrt_ps(unit_float(x0)));
+			__m128 beta = _mm_mul_ps(unit_float(x1), _mm_sub_ps(one, alpha));
+			__m128 gamma = _mm_sub_ps(_mm_sub_ps(one, alpha), beta);
+
+			Lanes<N> lanes;
+			_mm_storeu_ps(lanes.px, interpolate(tri.p0.x, tri.p1.x, tri.p2.x, alpha, beta, gamma));
+			_mm_storeu_ps(lanes.py, interpolate(tri.p0.y, tri.p1.y, tri.p2.y, alpha, beta, gamma));
+			_mm_storeu_ps(lanes.pz, interpolate(tri.p0.z, tri.p1.z, tri.p2.z, alpha, beta, gamma));
+			_mm_storeu_ps(lanes.nx, interpolate(normals.n0.x, normals.n1.x, normals.n2.x, alpha, beta, gamma));
+			_mm_storeu_ps(lanes.ny, interpolate(normals.n0.y, normals.n1.y, normals.n2.y, alpha, beta, gamma));
+			_mm_storeu_ps(lanes.nz, interpolate(normals.n0.z, normals.n1.z, normals.n2.z, alpha, beta, gamma));
+			write_lanes(lanes, material_id, out.begin() + i);
+		}
+		sample_strokes_scalar(tri, normals, material_id, key, first_stroke, out, i);
+	}
+
+	struct MulHiLo256 { __m256i hi; __m256i lo; };
+	// Same as the 128-bit version: the shuffles and unpacks work within each 128-bit half.
+	__attribute__((target("avx2")))
+	inline MulHiLo256 mul_hi_lo(__m256i a, __m256i m) {
+		__m256i even = _mm256_shuffle_epi32(_mm256_mul_epu32(a, m), _MM_SHUFFLE(3, 1, 2, 0));
+		__m256i odd = _mm256_shuffle_epi32(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), m), _MM_SHUFFLE(3, 1, 2, 0));
+		return MulHiLo256 { _mm256_unpackhi_epi32(even, odd), _mm256_unpacklo_epi32(even, odd) };
+	}
+
+	__attribute__((target("avx2")))
+	inline __m256 unit_float(__m256i u) {
+		return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(u, 8)), _mm256_set1_ps(UNIT_FLOAT_SCALE));
+	}
+
+	__attribute__((target("avx2")))
+	inline __m256 interpolate(float a, float b, float c, __m256 alpha, __m256 beta, __m256 gamma) {
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a), alpha), _mm256_mul_ps(_mm256_set1_ps(b), beta)), _mm256_mul_ps(_mm256_set1_ps(c), gamma));
+	}
+
+	__attribute__((target("avx2")))
+	void sample_strokes_avx2(const Triangle& tri, const Normals& normals, u32 material_id, PhiloxKey key, u32 first_stroke, MutableSlice<VertexAttributesDotOrDebug> out) {
+		const u32 N = 8;
+		const __m256i m0 = _mm256_set1_epi32(static_cast<int>(PHILOX_M0));
+		const __m256i m1 = _mm256_set1_epi32(static_cast<int>(PHILOX_M1));
+		const __m256 one = _mm256_set1_ps(1.0f);
+		u32 i = 0;
+		for (; i + N <= out.size(); i += N) {
+			__m256i x0 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first_stroke + i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+			__m256i x1 = _mm256_setzero_si256();
+			__m256i x2 = _mm256_setzero_si256();
+			__m256i x3 = _mm256_setzero_si256();
+			PhiloxKey k = key;
+			for (u32 round = 0; round != 10; ++round) {
+				MulHiLo256 p0 = mul_hi_lo(x0, m0);
+				MulHiLo256 p1 = mul_hi_lo(x2, m1);
+				x0 = _mm256_xor_si256(_mm256_xor_si256(p1.hi, x1), _mm256_set1_epi32(static_cast<int>(k.k0)));
+				x1 = p1.lo;
+				x2 = _mm256_xor_si256(_mm256_xor_si256(p0.hi, x3), _mm256_set1_epi32(static_cast<int>(k.k1)));
+				x3 = p0.lo;
+				k.k0 += PHILOX_W0;
+				k.k1 += PHILOX_W1;
+			}
+
+			__m256 alpha = _mm256_sub_ps(one, _mm256_sqrt_ps(unit_float(x0)));
+			__m256 beta = _mm256_mul_ps(unit_float(x1), _mm256_sub_ps(one, alpha));
+			__m256 gamma = _mm256_sub_ps(_mm256_sub_ps(one, alpha), beta);
+
+			Lanes<N> lanes;
+			_mm256_storeu_ps(lanes.px, interpolate(tri.p0.x, tri.p1.x, tri.p2.x, alpha, beta, gamma));
+			_mm256_storeu_ps(lanes.py, interpolate(tri.p0.y, tri.p1.y, tri.p2.y, alpha, beta, gamma));
+			_mm256_storeu_ps(lanes.pz, interpolate(tri.p0.z, tri.p1.z, tri.p2.z, alpha, beta, gamma));
+			_mm256_storeu_ps(lanes.nx, interpolate(normals.n0.x, normals.n1.x, normals.n2.x, alpha, beta, gamma));
+			_mm256_storeu_ps(lanes.ny, interpolate(normals.n0.y, normals.n1.y, normals.n2.y, alpha, beta, gamma));
+			_mm256_storeu_ps(lanes.nz, interpolate(normals.n0.z, normals.n1.z, normals.n2.z, alpha, beta, gamma));
+			write_lanes(lanes, material_id, out.begin() + i);
+		}
+		sample_strokes_scalar(tri, normals, material_id, key, first_stroke, out, i);
+	}
+#endif
+
+	using Kernel = void (*)(const Triangle&, const Normals&, u32, PhiloxKey, u32, MutableSlice<VertexAttributesDotOrDebug>);
+
+	void sample_strokes_scalar_kernel(const Triangle& tri, const Normals& normals, u32 material_id, PhiloxKey key, u32 first_stroke, MutableSlice<VertexAttributesDotOrDebug> out) {
+		sample_strokes_scalar(tri, normals, material_id, key, first_stroke, out, 0);
+	}
+
+	struct NamedKernel {
+		const char* name;
+		Kernel kernel;
+	};
+
+	// Writes the kernels this CPU supports to `out`, best last, and returns how many there are.
+	u32 get_supported_kernels(NamedKernel out[3]) {
+		u32 n = 0;
+		out[n++] = NamedKernel { "scalar", sample_strokes_scalar_kernel };
+#ifdef __x86_64__
+		out[n++] = NamedKernel { "sse2", sample_strokes_sse2 };
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			out[n++] = NamedKernel { "avx2", sample_strokes_avx2 };
+#endif
+		return n;
+	}
+
+	Kernel choose_kernel() {
+		NamedKernel kernels[3];
+		u32 n = get_supported_kernels(kernels);
+		return kernels[n - 1].kernel;
+	}
+
+	// What gen_dots did before there were kernels: a double-precision sqrt and a sanity check per sample.
+	void sample_strokes_unbatched(const Triangle& tri, const Normals& normals, u32 material_id, PhiloxKey key, u32 first_stroke, MutableSlice<VertexAttributesDotOrDebug> out) {
+		for (u32 i = 0; i != out.size(); ++i) {
+			PhiloxBlock rand = philox4x32_10(PhiloxBlock { first_stroke + i, 0, 0, 0 }, key);
+			float alpha = 1.0f - static_cast<float>(sqrt(static_cast<double>(u32_to_unit_float(rand.x0))));
+			float beta = u32_to_unit_float(rand.x1) * (1.0f - alpha);
+			float gamma = 1.0f - alpha - beta;
+			check(fabsf(alpha + beta + gamma - 1.0f) < 0.01f);
+			out[i] = VertexAttributesDotOrDebug {
+				tri.p0 * alpha + tri.p1 * beta + tri.p2 * gamma,
+				normals.n0 * alpha + normals.n1 * beta + normals.n2 * gamma,
+				material_id,
+			};
+		}
+	}
+
+	Triangle benchmark_triangle() {
+		return Triangle { glm::vec3 { 0, 0, 0 }, glm::vec3 { 1, 0, 0.5f }, glm::vec3 { 0.25f, 1, 0 } };
+	}
+
+	Normals benchmark_normals() {
+		return Normals { glm::vec3 { 0, 0, 1 }, glm::vec3 { 0, 1, 0 }, glm::vec3 { 1, 0, 0 } };
+	}
+}
+
+void sample_strokes(const Triangle& tri, const Normals& normals, u32 material_id, PhiloxKey key, u32 first_stroke, MutableSlice<VertexAttributesDotOrDebug> out) {
+	static const Kernel kernel = choose_kernel();
+	kernel(tri, normals, material_id, key, first_stroke, out);
+}
+
+void benchmark_sample_strokes() {
+	// Small batches, since real faces only get a handful of strokes each.
+	const u32 BATCH_SIZE = 61;
+	const u32 N_BATCHES = 100000;
+	Triangle tri = benchmark_triangle();
+	Normals normals = benchmark_normals();
+	PhiloxKey key = philox_key(1);
+
+	NamedKernel kernels[4];
+	kernels[0] = NamedKernel { "unbatched", sample_strokes_unbatched };
+	u32 n_kernels = 1 + get_supported_kernels(kernels + 1);
+	DynArray<VertexAttributesDotOrDebug> reference = DynArray<VertexAttributesDotOrDebug>::uninitialized(BATCH_SIZE);
+	DynArray<VertexAttributesDotOrDebug> out = DynArray<VertexAttributesDotOrDebug>::uninitialized(BATCH_SIZE);
+	sample_strokes_scalar_kernel(tri, normals, 0, key, 0, reference.mutable_slice());
+
+	for (u32 k = 0; k != n_kernels; ++k) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (u32 batch = 0; batch != N_BATCHES; ++batch)
+			kernels[k].kernel(tri, normals, 0, key, batch * BATCH_SIZE, out.mutable_slice());
+		std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+
+		kernels[k].kernel(tri, normals, 0, key, 0, out.mutable_slice());
+		bool matches = memcmp(out.begin(), reference.begin(), BATCH_SIZE * sizeof(VertexAttributesDotOrDebug)) == 0;
+		std::cout << kernels[k].name << ": " << static_cast<double>(BATCH_SIZE) * N_BATCHES / time.count() / 1e6 << "M samples/s"
+			<< (matches ? "" : " (MISMATCH)") << std::endl;
+	}
+}
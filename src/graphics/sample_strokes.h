@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include "../util/MutableSlice.h"
+#include "../util/Philox.h"
+#include "./RenderableModel.h"
+
+struct Triangle {
+	glm::vec3 p0;
+	glm::vec3 p1;
+	glm::vec3 p2;
+};
+
+struct Normals {
+	glm::vec3 n0;
+	glm::vec3 n1;
+	glm::vec3 n2;
+};
+
+// Fills `out` with strokes at uniformly random points on the triangle, with interpolated normals.
+// out[i] gets its random numbers from stroke index first_stroke + i, so the result doesn't depend on how strokes are batched.
+// Uses the widest SIMD the CPU supports; every kernel gives bit-identical output.
+void sample_strokes(const Triangle& tri, const Normals& normals, u32 material_id, PhiloxKey key, u32 first_stroke, MutableSlice<VertexAttributesDotOrDebug> out);
+
+// Prints samples per second for each available kernel and for the old one-at-a-time path, and checks that they all agree.
+void benchmark_sample_strokes();
@@ -1,6 +1,7 @@
 #include "./shader_utils.h"
 
 #include <GL/glew.h>
+#include <glm/mat4x4.hpp>
 #include <iostream> // cerr
 
 #include "../util/io.h"
@@ -10,6 +11,17 @@
 #include "./RenderableModel.h"
 
 namespace {
+	// A mat4 attribute takes one location per column.
+	const u32 MAT4_COLUMNS = 4;
+
+	GLuint model_attrib_location(ShadersKind kind) {
+		switch (kind) {
+			case ShadersKind::Tri: return 2;
+			case ShadersKind::Dot:
+			case ShadersKind::Debug: return 3;
+		}
+	}
+
 	GLuint add_shader(ShaderProgram shader_program, Slice<char> shader_source, GLenum shader_type) {
 		GLuint shader_id = glCreateShader(shader_type);
 		check(shader_id != 0);
@@ -109,5 +121,23 @@ Shaders set_attrib_pointers(const Shaders& shaders, ShadersKind kind) {
 		}
 	}
 
+	GLuint model_attrib = get_attrib("a_model", model_attrib_location(kind));
+	for (GLuint column = 0; column != MAT4_COLUMNS; ++column) {
+		glEnableVertexAttribArray(model_attrib + column);
+		glVertexAttribDivisor(model_attrib + column, 1);
+	}
+
 	return shaders;
 }
+
+void set_instance_attrib_pointers(ShadersKind kind, size_t offset) {
+	GLuint model_attrib = model_attrib_location(kind);
+	for (GLuint column = 0; column != MAT4_COLUMNS; ++column)
+		glVertexAttribPointer(
+			model_attrib + column,
+			safe_div(sizeof(glm::vec4), sizeof(float)),
+			/*type*/ GL_FLOAT,
+			/*normalized*/ GL_FALSE,
+			sizeof(glm::mat4),
+			reinterpret_cast<void*>(offset + column * sizeof(glm::vec4)));
+}
@@ -5,4 +5,7 @@
 
 enum class ShadersKind { Tri, Dot, Debug };
 Shaders compile_shaders(const std::string& name, const std::string& cwd);
+// Also enables the per-instance `a_model` attribute, which `set_instance_attrib_pointers` points at the instance buffer.
 Shaders set_attrib_pointers(const Shaders& shaders, ShadersKind kind);
+// Call with the VAO and the instance buffer bound. Instance 0 will read the matrix `offset` bytes into the buffer.
+void set_instance_attrib_pointers(ShadersKind kind, size_t offset);
@@ -0,0 +1,233 @@
+#include "./vertex_cache.h"
+
+#include <algorithm> // min, shuffle, swap
+#include <chrono>
+#include <cmath> // powf
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "../model/adjacency.h"
+#include "../util/FixedArray.h"
+
+namespace {
+	// Tuning from the paper. The simulated cache is an LRU, which approximates real hardware well enough.
+	const u32 CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	const u32 NOT_IN_CACHE = std::numeric_limits<u32>::max();
+	const u32 NO_TRIANGLE = std::numeric_limits<u32>::max();
+
+	float vertex_score(u32 cache_position, u32 n_remaining_triangles) {
+		if (n_remaining_triangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cache_position == NOT_IN_CACHE)
+			score = 0.0f;
+		else if (cache_position < 3)
+			// The last triangle's vertices all score the same, so it doesn't matter what order they were added in.
+			score = LAST_TRIANGLE_SCORE;
+		else
+			score = powf(1.0f - static_cast<float>(cache_position - 3) / static_cast<float>(CACHE_SIZE - 3), CACHE_DECAY_POWER);
+
+		// Favor vertices with few triangles left, so we finish them off instead of leaving lone triangles for later.
+		return score + VALENCE_BOOST_SCALE * powf(static_cast<float>(n_remaining_triangles), -VALENCE_BOOST_POWER);
+	}
+
+	class Optimizer {
+		Slice<u32> indices;
+		// The first `n_remaining[v]` faces listed for v are the ones not yet emitted.
+		VertexFaceAdjacency adjacency;
+		DynArray<u32> n_remaining;
+		DynArray<u32> cache_positions;
+		DynArray<float> vertex_scores;
+		DynArray<float> triangle_scores;
+		DynArray<bool> emitted;
+
+		// Most recently used first. Has room for a whole triangle beyond CACHE_SIZE while it's being updated.
+		FixedArray<CACHE_SIZE + 3, u32> cache;
+		u32 cache_size;
+
+		inline u32 n_triangles() const { return indices.size() / 3; }
+
+		void update_vertex_score(u32 v) {
+			vertex_scores[v] = vertex_score(cache_positions[v], n_remaining[v]);
+		}
+
+		void update_triangle_scores(u32 v) {
+			for (u32 i = adjacency.offsets[v]; i != adjacency.offsets[v] + n_remaining[v]; ++i) {
+				u32 t = adjacency.faces[i];
+				triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+			}
+		}
+
+		void remove_remaining_triangle(u32 v, u32 t) {
+			u32 begin = adjacency.offsets[v];
+			u32 last = begin + n_remaining[v] - 1;
+			for (u32 i = begin; i <= last; ++i)
+				if (adjacency.faces[i] == t) {
+					std::swap(adjacency.faces[i], adjacency.faces[last]);
+					--n_remaining[v];
+					return;
+				}
+			unreachable(); // t wasn't remaining
+		}
+
+		// Moves the triangle's vertices to the front of the cache and rescores everything whose position changed.
+		// Returns the best triangle using a vertex in the cache, or NO_TRIANGLE.
+		u32 emit(u32 t) {
+			emitted[t] = true;
+
+			FixedArray<CACHE_SIZE + 3, u32> new_cache;
+			u32 new_cache_size = 0;
+			for (u32 corner = 0; corner != 3; ++corner) {
+				u32 v = indices[t * 3 + corner];
+				remove_remaining_triangle(v, t);
+				bool is_duplicate = false;
+				for (u32 i = 0; i != new_cache_size; ++i)
+					is_duplicate = is_duplicate || new_cache[i] == v;
+				if (!is_duplicate)
+					new_cache[new_cache_size++] = v;
+			}
+			u32 n_new = new_cache_size;
+
+			for (u32 i = 0; i != cache_size; ++i) {
+				u32 v = cache[i];
+				bool in_triangle = false;
+				for (u32 j = 0; j != n_new; ++j)
+					in_triangle = in_triangle || new_cache[j] == v;
+				if (!in_triangle)
+					new_cache[new_cache_size++] = v;
+			}
+
+			// Anything past CACHE_SIZE falls out of the cache.
+			for (u32 i = CACHE_SIZE; i < new_cache_size; ++i) {
+				u32 v = new_cache[i];
+				cache_positions[v] = NOT_IN_CACHE;
+				update_vertex_score(v);
+			}
+			cache_size = std::min(new_cache_size, CACHE_SIZE);
+			for (u32 i = 0; i != cache_size; ++i) {
+				u32 v = new_cache[i];
+				cache[i] = v;
+				cache_positions[v] = i;
+				update_vertex_score(v);
+			}
+
+			for (u32 i = 0; i != new_cache_size; ++i)
+				update_triangle_scores(new_cache[i]);
+
+			u32 best = NO_TRIANGLE;
+			float best_score = -1.0f;
+			for (u32 i = 0; i != cache_size; ++i) {
+				u32 v = cache[i];
+				for (u32 j = adjacency.offsets[v]; j != adjacency.offsets[v] + n_remaining[v]; ++j) {
+					u32 candidate = adjacency.faces[j];
+					if (triangle_scores[candidate] > best_score) {
+						best = candidate;
+						best_score = triangle_scores[candidate];
+					}
+				}
+			}
+			return best;
+		}
+
+	public:
+		Optimizer(Slice<u32> _indices, u32 n_vertices)
+			: indices{_indices},
+			adjacency{build_vertex_face_adjacency(n_vertices, _indices)},
+			n_remaining{DynArray<u32>::uninitialized(n_vertices)},
+			cache_positions{DynArray<u32>::uninitialized(n_vertices)},
+			vertex_scores{DynArray<float>::uninitialized(n_vertices)},
+			triangle_scores{DynArray<float>::uninitialized(n_triangles())},
+			emitted{DynArray<bool>::uninitialized(n_triangles())},
+			cache{},
+			cache_size{0} {
+			for (u32 v = 0; v != n_vertices; ++v) {
+				n_remaining[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+				cache_positions[v] = NOT_IN_CACHE;
+				update_vertex_score(v);
+			}
+			for (u32 t = 0; t != n_triangles(); ++t)
+				emitted[t] = false;
+			for (u32 v = 0; v != n_vertices; ++v)
+				update_triangle_scores(v);
+		}
+
+		DynArray<u32> run() {
+			DynArray<u32> out = DynArray<u32>::uninitialized(indices.size());
+
+			u32 best = 0;
+			for (u32 t = 1; t != n_triangles(); ++t)
+				if (triangle_scores[t] > triangle_scores[best])
+					best = t;
+
+			// Fallback when nothing in the cache has triangles left. Everything before this has been emitted.
+			u32 next_unemitted = 0;
+			for (u32 n_emitted = 0; n_emitted != n_triangles(); ++n_emitted) {
+				if (best == NO_TRIANGLE) {
+					while (emitted[next_unemitted]) ++next_unemitted;
+					best = next_unemitted;
+				}
+				for (u32 corner = 0; corner != 3; ++corner)
+					out[n_emitted * 3 + corner] = indices[best * 3 + corner];
+				best = emit(best);
+			}
+			return out;
+		}
+	};
+}
+
+DynArray<u32> optimize_vertex_cache(Slice<u32> triangle_indices, u32 n_vertices) {
+	check(triangle_indices.size() % 3 == 0 && triangle_indices.size() != 0);
+	return Optimizer { triangle_indices, n_vertices }.run();
+}
+
+namespace {
+	// Average cache misses per triangle with a FIFO cache, as on most GPUs. 3 is the worst; around 0.5 is the best a large mesh can do.
+	float acmr(Slice<u32> indices, u32 n_vertices, u32 fifo_size) {
+		std::vector<u32> inserted_at(n_vertices, NOT_IN_CACHE);
+		u32 n_misses = 0;
+		for (u32 v : indices) {
+			if (inserted_at[v] == NOT_IN_CACHE || n_misses - inserted_at[v] >= fifo_size) {
+				inserted_at[v] = n_misses;
+				++n_misses;
+			}
+		}
+		return static_cast<float>(n_misses) / static_cast<float>(indices.size() / 3);
+	}
+}
+
+void benchmark_vertex_cache() {
+	// A grid of 200x200 quads is 80000 triangles. Shuffling them leaves no locality to start with.
+	const u32 GRID_SIZE = 200;
+	const u32 FIFO_SIZE = 16;
+	u32 row = GRID_SIZE + 1;
+	struct Triangle { u32 v[3]; };
+	std::vector<Triangle> triangles;
+	for (u32 y = 0; y != GRID_SIZE; ++y)
+		for (u32 x = 0; x != GRID_SIZE; ++x) {
+			u32 v = y * row + x;
+			triangles.push_back(Triangle { { v, v + 1, v + row } });
+			triangles.push_back(Triangle { { v + 1, v + row + 1, v + row } });
+		}
+	std::shuffle(triangles.begin(), triangles.end(), std::mt19937 { 1 });
+	std::vector<u32> indices;
+	for (const Triangle& t : triangles)
+		for (u32 v : t.v)
+			indices.push_back(v);
+	Slice<u32> shuffled = vec_to_slice(indices);
+	u32 n_vertices = row * row;
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	DynArray<u32> optimized = optimize_vertex_cache(shuffled, n_vertices);
+	std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+
+	std::cout << triangles.size() << " shuffled triangles, ACMR with a " << FIFO_SIZE << "-entry FIFO: " << acmr(shuffled, n_vertices, FIFO_SIZE)
+		<< " before, " << acmr(optimized.slice(), n_vertices, FIFO_SIZE) << " after. Optimizing took " << time.count() * 1000.0 << "ms" << std::endl;
+}
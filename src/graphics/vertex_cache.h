@@ -0,0 +1,11 @@
+#pragma once
+
+#include "../util/DynArray.h"
+
+// Reorders the triangles of a triangle list so that consecutive triangles share vertices,
+// so fewer vertices miss the GPU's post-transform cache.
+// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation".
+DynArray<u32> optimize_vertex_cache(Slice<u32> triangle_indices, u32 n_vertices);
+
+// Prints the average cache miss ratio of a shuffled grid before and after optimizing.
+void benchmark_vertex_cache();
@@ -8,6 +8,9 @@
 
 #include "graphics/convert_model.h"
 #include "graphics/Graphics.h"
+#include "graphics/sample_strokes.h"
+#include "graphics/vertex_cache.h"
+#include "physics/ConvexHull.h"
 
 #include "./vendor/readerwriterqueue/readerwriterqueue.h"
 
@@ -19,8 +22,8 @@
 
 
 #include "./util/Ref.h"
+#include "./FramePacer.h"
 #include "./game.h"
-#include "util/FixedSizeQueue.h"
 
 namespace {
 	template <typename Cb>
@@ -59,9 +62,25 @@ namespace {
 	}
 }
 
-int main() {
+int main(int argc, char** argv) {
 	if ((false)) test_sound();
 	if ((false)) test_input();
+	if ((false)) benchmark_sample_strokes();
+	if ((false)) benchmark_vertex_cache();
+	if ((false)) test_quickhull();
+
+	// `myproject --capture <out dir> <n frames> [png compression level]` renders without a window.
+	// It also prints per-pass timings and writes a Chrome trace of them to <out dir>/trace.json.
+	if ((argc == 4 || argc == 5) && std::string { argv[1] } == "--capture") {
+		int png_compression_level = argc == 5 ? std::stoi(argv[4]) : DEFAULT_PNG_OPTIONS.compression_level;
+		capture_frames(get_current_directory(), argv[2], ulong_to_u32(std::stoul(argv[3])), png_compression_level);
+		return 0;
+	}
+
+	// `myproject [--fps <n | unlimited>]`
+	u32 target_fps = DEFAULT_TARGET_FPS;
+	if (argc == 3 && std::string { argv[1] } == "--fps")
+		target_fps = std::string { argv[2] } == "unlimited" ? UNLIMITED_FPS : ulong_to_u32(std::stoul(argv[2]));
 
-	if ((true)) game(get_current_directory());
+	if ((true)) game(get_current_directory(), target_fps);
 }
@@ -4,20 +4,23 @@
 
 #include "../util/DynArray.h"
 #include "../util/FixedArray.h"
+#include "../util/IndexBuffer.h"
 #include "../util/int.h"
 
 #include "./Color.h"
 #include "./ModelKind.h"
 //Note: texture and vertex indices were parsed away from 1-based. So this is 1 less than what's in the file.
 
+// Indices are u16 for meshes with up to 65536 vertices and normals, and u32 for larger ones.
+template <typename Index>
 struct Face {
-	u8 material;
-	u8 vertex_0;
-	u8 vertex_1;
-	u8 vertex_2;
-	u8 normal_0;
-	u8 normal_1;
-	u8 normal_2;
+	u16 material;
+	Index vertex_0;
+	Index vertex_1;
+	Index vertex_2;
+	Index normal_0;
+	Index normal_1;
+	Index normal_2;
 };
 
 struct ParsedMaterial {
@@ -36,5 +39,18 @@ struct Model {
 	DynArray<ParsedMaterial> materials;
 	DynArray<glm::vec3> vertices;
 	DynArray<glm::vec3> normals;
-	DynArray<Face> faces;
+	// Only the array matching `index_width` is non-empty.
+	IndexWidth index_width;
+	DynArray<Face<u16>> faces_u16;
+	DynArray<Face<u32>> faces_u32;
+
+	inline u32 n_faces() const {
+		return index_width == IndexWidth::U16 ? faces_u16.size() : faces_u32.size();
+	}
+
+	// Calls `cb` with a Slice<Face<u16>> or a Slice<Face<u32>>.
+	template <typename Cb>
+	auto with_faces(Cb cb) const {
+		return index_width == IndexWidth::U16 ? cb(faces_u16.slice()) : cb(faces_u32.slice());
+	}
 };
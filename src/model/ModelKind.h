@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../util/int.h"
+
 enum class ModelKind {
 	Player,
 
@@ -16,3 +18,15 @@ inline u32 model_kind_to_u32(ModelKind m) {
 	return u32(m);
 }
 
+// Also the model's file name, without the extension.
+inline const char* model_kind_name(ModelKind kind) {
+	switch (kind) {
+		case ModelKind::Player:
+			return "player";
+		case ModelKind::Cylinder:
+			return "cylinder";
+		case ModelKind::COUNT:
+			return nullptr;
+	}
+}
+
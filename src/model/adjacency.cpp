@@ -0,0 +1,91 @@
+#include "./adjacency.h"
+
+#include <algorithm> // min
+#include <glm/geometric.hpp> // cross, length
+
+namespace {
+	// `get_vertex(f, corner)` is the vertex at corner 0, 1 or 2 of face f.
+	template <typename GetVertex>
+	VertexFaceAdjacency build(u32 n_vertices, u32 n_faces, GetVertex get_vertex) {
+		// Count the faces at each vertex, then turn counts into offsets with a prefix sum.
+		// offsets[v + 1] is the count for v, so after the prefix sum offsets[v] is where v's faces start.
+		DynArray<u32> offsets = DynArray<u32>::uninitialized(n_vertices + 1);
+		for (u32& o : offsets) o = 0;
+		for (u32 f = 0; f != n_faces; ++f)
+			for (u32 corner = 0; corner != 3; ++corner)
+				++offsets[get_vertex(f, corner) + 1];
+		for (u32 v = 0; v != n_vertices; ++v)
+			offsets[v + 1] += offsets[v];
+
+		// Fill by walking faces in order, so each vertex's list comes out sorted.
+		DynArray<u32> cursors = DynArray<u32>::uninitialized(n_vertices);
+		for (u32 v = 0; v != n_vertices; ++v)
+			cursors[v] = offsets[v];
+		DynArray<u32> adjacent_faces = DynArray<u32>::uninitialized(safe_mul(n_faces, 3));
+		for (u32 f = 0; f != n_faces; ++f)
+			for (u32 corner = 0; corner != 3; ++corner)
+				adjacent_faces[cursors[get_vertex(f, corner)]++] = f;
+		return VertexFaceAdjacency { std::move(offsets), std::move(adjacent_faces) };
+	}
+
+	template <typename Index>
+	u32 face_vertex(const Face<Index>& face, u32 corner) {
+		return corner == 0 ? face.vertex_0 : corner == 1 ? face.vertex_1 : face.vertex_2;
+	}
+
+	// Enough per task that handing out tasks costs little next to the work.
+	const u32 ITEMS_PER_CHUNK = 4096;
+
+	// Calls cb(begin, end) for consecutive ranges of 0..n, in parallel.
+	template <typename Cb>
+	void for_each_chunk(ThreadPool& thread_pool, u32 n, Cb cb) {
+		u32 n_chunks = (n + ITEMS_PER_CHUNK - 1) / ITEMS_PER_CHUNK;
+		thread_pool.parallel_for(n_chunks, [&](u32 chunk) {
+			u32 begin = chunk * ITEMS_PER_CHUNK;
+			cb(begin, std::min(begin + ITEMS_PER_CHUNK, n));
+		});
+	}
+
+	// Length is twice the face's area, so summing these weights each face by its area.
+	template <typename Index>
+	glm::vec3 area_weighted_normal(const Model& m, const Face<Index>& face) {
+		glm::vec3 p0 = m.vertices[face.vertex_0];
+		return glm::cross(m.vertices[face.vertex_1] - p0, m.vertices[face.vertex_2] - p0);
+	}
+}
+
+VertexFaceAdjacency build_vertex_face_adjacency(const Model& m) {
+	return m.with_faces([&](auto faces) {
+		return build(m.vertices.size(), faces.size(), [&](u32 f, u32 corner) { return face_vertex(faces[f], corner); });
+	});
+}
+
+VertexFaceAdjacency build_vertex_face_adjacency(u32 n_vertices, Slice<u32> triangle_indices) {
+	check(triangle_indices.size() % 3 == 0);
+	return build(n_vertices, triangle_indices.size() / 3, [&](u32 f, u32 corner) { return triangle_indices[f * 3 + corner]; });
+}
+
+DynArray<glm::vec3> compute_smooth_normals(const Model& m, const VertexFaceAdjacency& adjacency, ThreadPool& thread_pool) {
+	return m.with_faces([&](auto faces) {
+		// glm::vec3 has no destructor, so a chunk that throws leaves nothing to clean up in these.
+		DynArray<glm::vec3> face_normals = DynArray<glm::vec3>::uninitialized(faces.size());
+		for_each_chunk(thread_pool, faces.size(), [&](u32 begin, u32 end) {
+			for (u32 f = begin; f != end; ++f)
+				face_normals[f] = area_weighted_normal(m, faces[f]);
+		});
+		// Gathering (rather than each face adding to its vertices) means each chunk writes only its own vertices,
+		// and sums in the same order regardless of thread count.
+		DynArray<glm::vec3> normals = DynArray<glm::vec3>::uninitialized(m.vertices.size());
+		for_each_chunk(thread_pool, m.vertices.size(), [&](u32 begin, u32 end) {
+			for (u32 v = begin; v != end; ++v) {
+				glm::vec3 sum { 0, 0, 0 };
+				for (u32 f : adjacency.faces_of(v))
+					sum += face_normals[f];
+				float length = glm::length(sum);
+				// A vertex used by no face (or only degenerate ones) has no normal.
+				normals[v] = length == 0.0f ? sum : sum / length;
+			}
+		});
+		return normals;
+	});
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include "../util/DynArray.h"
+#include "../util/ThreadPool.h"
+#include "./Model.h"
+
+// Compressed sparse row: the faces using vertex v are `faces[offsets[v] .. offsets[v + 1]]`, in ascending order.
+struct VertexFaceAdjacency {
+	DynArray<u32> offsets; // One per vertex, plus one for the end.
+	DynArray<u32> faces; // Indices into the model's faces. Three per face.
+
+	inline Slice<u32> faces_of(u32 vertex) const {
+		return Slice<u32> { faces.begin() + offsets[vertex], faces.begin() + offsets[vertex + 1] };
+	}
+};
+
+VertexFaceAdjacency build_vertex_face_adjacency(const Model& m);
+// Same, for a triangle list where face f is `triangle_indices[f * 3 .. f * 3 + 3]`.
+VertexFaceAdjacency build_vertex_face_adjacency(u32 n_vertices, Slice<u32> triangle_indices);
+
+// One normal per vertex: the area-weighted average of the normals of the faces around it, assuming counter-clockwise winding.
+// The vertex normals in the .obj are ignored.
+DynArray<glm::vec3> compute_smooth_normals(const Model& m, const VertexFaceAdjacency& adjacency, ThreadPool& thread_pool);
@@ -1,203 +1,415 @@
 #include "parse_model.h"
 
-#include <sstream>
-#include <vector>
+#include <cmath>
+#include <cstring> // memset
+#include <type_traits> // is_trivially_copyable
 
-#include "../assert.h"
+#include "../util/assert.h"
+#include "../util/string.h"
 
+// The parser works directly on the file contents: it never allocates a string, and every output array is sized
+// exactly once by a counting pass over the source before anything is parsed.
 namespace {
-	void skip_str(std::istringstream& s) {
-		std::string str;
-		s >> str;
-	}
-
-	std::string read_str(std::istringstream& s) {
-		std::string res;
-		s >> res;
+	// Model caches store faces and materials as raw bytes, padding included (Face<u32> has 2 bytes after `material`).
+	// Zeroing it keeps the same model from giving different cache files.
+	template <typename T>
+	DynArray<T> zeroed(u32 size) {
+		static_assert(std::is_trivially_copyable<T>::value, "");
+		DynArray<T> res = DynArray<T>::uninitialized(size);
+		memset(static_cast<void*>(res.begin()), 0, size * sizeof(T));
 		return res;
 	}
 
-	void expect_str(std::istringstream& s, const char* expected) {
-		std::string str = read_str(s);
-		check(str == expected);
+	struct Reader {
+		const char* cur;
+		const char* end;
+
+		explicit Reader(Slice<char> source) : cur{source.begin()}, end{source.end()} {}
 	};
 
-	u8 read_u8(std::istringstream& s) {
-		u64 u;
-		s >> u;
-		return u64_to_u8(u);
+	inline bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
 	}
 
-	// Some indices are 1-based in the .obj file, but we want 0-based.
-	u8 read_u8_minus_one(std::istringstream& s) {
-		u8 u = read_u8(s);
-		check(u != 0);
-		return static_cast<u8>(u - 1);
+	inline bool is_digit(char c) {
+		return c >= '0' && c <= '9';
 	}
 
-	float read_float(std::istringstream& s) {
-		float f;
-		s >> f;
-		return f;
+	inline u8 digit_value(char c) {
+		return static_cast<u8>(c - '0');
 	}
 
-	glm::vec3 read_vec3(std::istringstream& s) {
-		float x = read_float(s);
-		float y = read_float(s);
-		float z = read_float(s);
-		return { x, y, z };
+	inline bool at_end(const Reader& r) {
+		return r.cur == r.end;
 	}
 
-	Color read_color(std::istringstream& s) {
-		return Color { read_vec3(s) };
+	inline char peek(const Reader& r) {
+		return at_end(r) ? '\0' : *r.cur;
 	}
 
-	char read_char(std::istringstream& s) {
-		int i = s.get();
-		check(i >= std::numeric_limits<char>::min() && i <= std::numeric_limits<char>::max());
-		return static_cast<char>(i);
+	// Skips spaces, but not newlines.
+	void skip_spaces(Reader& r) {
+		while (!at_end(r) && is_space(*r.cur))
+			++r.cur;
 	}
 
-	void expect_char(std::istringstream& s, char expected) {
-		char c = read_char(s);
-		check(c == expected);
+	void skip_whitespace(Reader& r) {
+		while (!at_end(r) && (is_space(*r.cur) || *r.cur == '\n'))
+			++r.cur;
 	}
 
-	struct FacePart { u8 vertex; u8 normal; };
-	FacePart read_face_part(std::istringstream& s) {
-		u8 vertex = read_u8_minus_one(s);
-		expect_char(s, '/');
-		expect_char(s, '/');
-		u8 normal = read_u8_minus_one(s);
-		return { vertex, normal };
+	void skip_line(Reader& r) {
+		while (!at_end(r) && *r.cur != '\n')
+			++r.cur;
+		if (!at_end(r))
+			++r.cur;
 	}
 
-	void read_face(std::istringstream& s, u8 material, std::vector<Face>& faces) {
-		FacePart a = read_face_part(s);
-		FacePart b = read_face_part(s);
-		FacePart c = read_face_part(s);
-		faces.push_back(Face { material, a.vertex, b.vertex, c.vertex, a.normal, b.normal, c.normal });
-		if (read_char(s) == '\n') return;
+	bool try_take_char(Reader& r, char c) {
+		if (peek(r) == c) {
+			++r.cur;
+			return true;
+		}
+		return false;
+	}
 
-		FacePart d = read_face_part(s);
-		faces.push_back(Face { material, c.vertex, d.vertex, a.vertex, c.normal, d.normal, a.normal });
+	void expect_char(Reader& r, char expected) {
+		check(try_take_char(r, expected));
 	}
 
-	void skip_line(std::istringstream& s) {
-		std::string str;
-		getline(s, str);
+	// Returned slice points into the source.
+	Slice<char> read_word(Reader& r) {
+		skip_whitespace(r);
+		const char* begin = r.cur;
+		while (!at_end(r) && !is_space(*r.cur) && *r.cur != '\n')
+			++r.cur;
+		return Slice<char> { begin, r.cur };
 	}
 
-	void skip_comments(std::istringstream& s) {
-		char c = read_char(s);
-		check(c == '#');
-		skip_line(s);
-		c = read_char(s);
-		check(c == '#');
-		skip_line(s);
+	void expect_word(Reader& r, const char* expected) {
+		check(slice_equals(read_word(r), expected));
 	}
 
-	void parse_materials(const std::string& file_content, std::vector<std::string>& material_names, std::vector<ParsedMaterial>& materials) {
-		std::istringstream s { file_content };
-		skip_comments(s);
+	u32 read_u32(Reader& r) {
+		skip_spaces(r);
+		check(is_digit(peek(r)));
+		u64 u = 0;
+		while (is_digit(peek(r))) {
+			u = u * 10 + digit_value(*r.cur);
+			check(u <= std::numeric_limits<u32>::max());
+			++r.cur;
+		}
+		return static_cast<u32>(u);
+	}
+
+	// Some indices are 1-based in the .obj file, but we want 0-based.
+	u32 read_u32_minus_one(Reader& r) {
+		u32 u = read_u32(r);
+		check(u != 0);
+		return u - 1;
+	}
+
+	// Powers of ten that are exactly representable as a double.
+	const double EXACT_POWERS_OF_10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	const int MAX_EXACT_POWER_OF_10 = 22;
+	// A u64 can hold any 19-digit number.
+	const u32 MAX_MANTISSA_DIGITS = 19;
 
-		while (!s.eof()) {
-			std::string newmtl = read_str(s);
-			if (newmtl != "newmtl") {
-				check(newmtl == "");
-				break;
+	double scale_by_power_of_10(double d, int exponent) {
+		if (exponent >= 0)
+			return exponent <= MAX_EXACT_POWER_OF_10 ? d * EXACT_POWERS_OF_10[exponent] : d * pow(10.0, exponent);
+		else
+			return -exponent <= MAX_EXACT_POWER_OF_10 ? d / EXACT_POWERS_OF_10[-exponent] : d * pow(10.0, exponent);
+	}
+
+	// Handles everything an exporter writes: optional sign, digits, optional fraction, optional exponent.
+	// Digits are accumulated into an integer and scaled once at the end, which is exact for the ~6 decimal places in .obj files.
+	float read_float(Reader& r) {
+		skip_spaces(r);
+		bool negative = try_take_char(r, '-');
+		if (!negative) try_take_char(r, '+');
+
+		u64 mantissa = 0;
+		u32 mantissa_digits = 0;
+		int exponent = 0;
+		bool any_digits = false;
+
+		for (; is_digit(peek(r)); ++r.cur) {
+			any_digits = true;
+			if (mantissa_digits < MAX_MANTISSA_DIGITS) {
+				mantissa = mantissa * 10 + digit_value(*r.cur);
+				if (mantissa != 0) ++mantissa_digits;
+			} else
+				++exponent; // Digit is too insignificant to matter, but still scales the number.
+		}
+
+		if (try_take_char(r, '.')) {
+			for (; is_digit(peek(r)); ++r.cur) {
+				any_digits = true;
+				if (mantissa_digits < MAX_MANTISSA_DIGITS) {
+					mantissa = mantissa * 10 + digit_value(*r.cur);
+					if (mantissa != 0) ++mantissa_digits;
+					--exponent;
+				}
 			}
+		}
+		check(any_digits);
 
-			std::string name = read_str(s);
-
-			expect_str(s, "Ns");
-			float ns = read_float(s);
-			expect_str(s, "Ka");
-			Color ka = read_color(s);
-			expect_str(s, "Kd");
-			Color kd = read_color(s);
-			expect_str(s, "Ks");
-			Color ks = read_color(s);
-			expect_str(s, "Ke");
-			Color ke = read_color(s);
-			expect_str(s, "Ni");
-			float ni = read_float(s);
-			expect_str(s, "d");
-			float d = read_float(s);
-			expect_str(s, "illum");
-			u8 illum = read_u8(s);
-
-			material_names.push_back(name);
-			// First id is 1
-			uint id = u64_to_u32(materials.size() + 1);
-			materials.push_back(ParsedMaterial { id, ns, ka, kd, ks, ke, ni, d, illum });
+		if (try_take_char(r, 'e') || try_take_char(r, 'E')) {
+			bool negative_exponent = try_take_char(r, '-');
+			if (!negative_exponent) try_take_char(r, '+');
+			int e = uint_to_int(read_u32(r));
+			exponent += negative_exponent ? -e : e;
 		}
+
+		double d = scale_by_power_of_10(static_cast<double>(mantissa), exponent);
+		return static_cast<float>(negative ? -d : d);
+	}
+
+	glm::vec3 read_vec3(Reader& r) {
+		float x = read_float(r);
+		float y = read_float(r);
+		float z = read_float(r);
+		return { x, y, z };
+	}
+
+	Color read_color(Reader& r) {
+		return Color { read_vec3(r) };
+	}
+
+	// Number of whitespace-separated words remaining on the current line. Does not advance the reader.
+	u32 count_words_on_line(const Reader& r) {
+		u32 n = 0;
+		bool in_word = false;
+		for (const char* c = r.cur; c != r.end && *c != '\n'; ++c) {
+			bool space = is_space(*c);
+			if (!space && !in_word) ++n;
+			in_word = !space;
+		}
+		return n;
 	}
-}
 
-Model parse_model(const char* mtl_source, const char* obj_source) {
-	std::vector<std::string> material_names;
-	std::vector<ParsedMaterial> materials;
-	parse_materials(mtl_source, material_names, materials);
+	// Only triangles and quads are supported.
+	u32 n_triangles_for_corners(u32 n_corners) {
+		check(n_corners == 3 || n_corners == 4);
+		return n_corners - 2;
+	}
 
-	std::istringstream s { obj_source };
+	struct ObjCounts {
+		u32 n_vertices;
+		u32 n_normals;
+		u32 n_faces; // After splitting quads
+	};
 
-	skip_comments(s);
+	// First pass: classify each line by its keyword so every array can be allocated exactly once.
+	ObjCounts count_obj(Slice<char> source) {
+		ObjCounts counts { 0, 0, 0 };
+		Reader r { source };
+		while (true) {
+			Slice<char> keyword = read_word(r);
+			if (keyword.size() == 0) break;
+			if (slice_equals(keyword, "v"))
+				++counts.n_vertices;
+			else if (slice_equals(keyword, "vn"))
+				++counts.n_normals;
+			else if (slice_equals(keyword, "f"))
+				counts.n_faces += n_triangles_for_corners(count_words_on_line(r));
+			skip_line(r);
+		}
+		return counts;
+	}
 
-	expect_str(s, "mtllib");
-	// This will be xxx.mtl
-	skip_str(s);
-	expect_str(s, "o");
-	// Don't really care about the name.
-	skip_str(s);
+	u32 count_materials(Slice<char> source) {
+		u32 n = 0;
+		Reader r { source };
+		while (true) {
+			Slice<char> keyword = read_word(r);
+			if (keyword.size() == 0) break;
+			if (slice_equals(keyword, "newmtl")) ++n;
+			skip_line(r);
+		}
+		return n;
+	}
 
-	// Read vertices
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec3> normals;
-	std::vector<Face> faces;
+	// Skips blank lines and '#' comments. Returns false at the end of the source.
+	bool skip_to_next_statement(Reader& r) {
+		while (true) {
+			skip_whitespace(r);
+			if (peek(r) != '#') return !at_end(r);
+			skip_line(r);
+		}
+	}
 
-	u8 current_material;
+	struct FacePart { u32 vertex; u32 normal; };
+	// Accepts both "v//vn" and "v/vt/vn". Texture coordinates are ignored.
+	FacePart read_face_part(Reader& r) {
+		u32 vertex = read_u32_minus_one(r);
+		expect_char(r, '/');
+		while (is_digit(peek(r)))
+			++r.cur;
+		expect_char(r, '/');
+		u32 normal = read_u32_minus_one(r);
+		return { vertex, normal };
+	}
 
-	auto set_current_material = [&]() {
-		std::string str = read_str(s);
-		current_material = index_of(vec_to_slice(material_names), str);
-	};
+	template <typename Index>
+	Index to_index(u32 i) {
+		check(i <= std::numeric_limits<Index>::max());
+		return static_cast<Index>(i);
+	}
 
-	while (true) {
-		std::string str = read_str(s);
-		if (str == "v") {
-			vertices.push_back(read_vec3(s));
-		} else {
-			check(str == "vn");
-			normals.push_back(read_vec3(s));
-			break;
+	// Sets each field, rather than assigning a whole Face, so that the zeroed padding stays zero. (See `zeroed`.)
+	template <typename Index>
+	void set_face(Face<Index>& out, u16 material, const FacePart& a, const FacePart& b, const FacePart& c, const ObjCounts& counts) {
+		check(a.vertex < counts.n_vertices && b.vertex < counts.n_vertices && c.vertex < counts.n_vertices);
+		check(a.normal < counts.n_normals && b.normal < counts.n_normals && c.normal < counts.n_normals);
+		out.material = material;
+		out.vertex_0 = to_index<Index>(a.vertex);
+		out.vertex_1 = to_index<Index>(b.vertex);
+		out.vertex_2 = to_index<Index>(c.vertex);
+		out.normal_0 = to_index<Index>(a.normal);
+		out.normal_1 = to_index<Index>(b.normal);
+		out.normal_2 = to_index<Index>(c.normal);
+	}
+
+	// Returns the number of faces written.
+	template <typename Index>
+	u32 read_face(Reader& r, u16 material, const ObjCounts& counts, MutableSlice<Face<Index>> out) {
+		u32 n_corners = count_words_on_line(r);
+		FacePart a = read_face_part(r);
+		FacePart b = read_face_part(r);
+		FacePart c = read_face_part(r);
+		set_face<Index>(out[0], material, a, b, c, counts);
+		if (n_corners == 3) return 1;
+
+		check(n_corners == 4);
+		FacePart d = read_face_part(r);
+		set_face<Index>(out[1], material, c, d, a, counts);
+		return 2;
+	}
+
+	u16 find_material(const Slice<Slice<char>>& material_names, const Slice<char>& name) {
+		u16 size = u32_to_u16(material_names.size());
+		for (u16 i = 0; i != size; ++i) {
+			if (slice_equals(material_names[i], name))
+				return i;
 		}
+		unreachable();
 	}
-	while (true) {
-		std::string str = read_str(s);
-		if (str == "vn") {
-			normals.push_back(read_vec3(s));
-		} else {
-			check(str == "usemtl");
-			set_current_material();
-			break;
+
+	// `material_names` point into `source`.
+	DynArray<ParsedMaterial> parse_materials(Slice<char> source, MutableSlice<Slice<char>> material_names) {
+		DynArray<ParsedMaterial> materials = zeroed<ParsedMaterial>(material_names.size());
+		Reader r { source };
+
+		for (u32 i = 0; i != material_names.size(); ++i) {
+			check(skip_to_next_statement(r));
+			expect_word(r, "newmtl");
+			material_names[i] = read_word(r);
+
+			expect_word(r, "Ns");
+			float ns = read_float(r);
+			expect_word(r, "Ka");
+			Color ka = read_color(r);
+			expect_word(r, "Kd");
+			Color kd = read_color(r);
+			expect_word(r, "Ks");
+			Color ks = read_color(r);
+			expect_word(r, "Ke");
+			Color ke = read_color(r);
+			expect_word(r, "Ni");
+			float ni = read_float(r);
+			expect_word(r, "d");
+			float d = read_float(r);
+			expect_word(r, "illum");
+			u8 illum = u32_to_u8(read_u32(r));
+
+			// First id is 1. Fields are set one at a time for the same reason as in `set_face`.
+			ParsedMaterial& m = materials[i];
+			m.id = i + 1;
+			m.ns = ns;
+			m.ka = ka;
+			m.kd = kd;
+			m.ks = ks;
+			m.ke = ke;
+			m.ni = ni;
+			m.d = d;
+			m.illum = illum;
+		}
+
+		check(!skip_to_next_statement(r));
+		return materials;
+	}
+}
+
+namespace {
+	struct ObjVertices {
+		DynArray<glm::vec3> vertices;
+		DynArray<glm::vec3> normals;
+	};
+
+	// Second pass: fill in everything that `count_obj` counted.
+	template <typename Index>
+	DynArray<Face<Index>> parse_obj(Slice<char> source, const ObjCounts& counts, const Slice<Slice<char>>& material_names, ObjVertices& out) {
+		DynArray<Face<Index>> faces = zeroed<Face<Index>>(counts.n_faces);
+		u32 vertex_i = 0;
+		u32 normal_i = 0;
+		u32 face_i = 0;
+
+		bool has_material = false;
+		u16 current_material = 0;
+
+		Reader r { source };
+		while (skip_to_next_statement(r)) {
+			Slice<char> keyword = read_word(r);
+			if (slice_equals(keyword, "v")) {
+				out.vertices[vertex_i++] = read_vec3(r);
+			} else if (slice_equals(keyword, "vn")) {
+				out.normals[normal_i++] = read_vec3(r);
+			} else if (slice_equals(keyword, "f")) {
+				check(has_material);
+				MutableSlice<Face<Index>> rest { faces.begin() + face_i, faces.size() - face_i };
+				face_i += read_face(r, current_material, counts, rest);
+			} else if (slice_equals(keyword, "usemtl")) {
+				current_material = find_material(material_names, read_word(r));
+				has_material = true;
+			} else if (slice_equals(keyword, "mtllib") || slice_equals(keyword, "o") || slice_equals(keyword, "s")) {
+				// "mtllib" is always xxx.mtl, don't care about the object name, and we treat everything as smooth.
+			} else
+				todo();
+			skip_line(r);
 		}
+
+		check(vertex_i == out.vertices.size() && normal_i == out.normals.size() && face_i == faces.size());
+		return faces;
 	}
+}
 
-	expect_str(s, "s");
-	expect_str(s, "1"); // Indicates that it's smooth
+Model parse_model(Slice<char> mtl_source, Slice<char> obj_source) {
+	DynArray<Slice<char>> material_names = DynArray<Slice<char>>::uninitialized(count_materials(mtl_source));
+	DynArray<ParsedMaterial> materials = parse_materials(mtl_source, material_names.mutable_slice());
 
-	while (true) {
-		std::string str = read_str(s);
-		if (str == "f")
-			read_face(s, current_material, faces);
-		else if (str == "usemtl")
-			set_current_material();
-		else if (str.empty())
+	ObjCounts counts = count_obj(obj_source);
+	ObjVertices v {
+		DynArray<glm::vec3>::uninitialized(counts.n_vertices),
+		DynArray<glm::vec3>::uninitialized(counts.n_normals),
+	};
+
+	// Counts are known before any face is read, so we can pick the index width up front.
+	IndexWidth index_width = index_width_for(counts.n_vertices > counts.n_normals ? counts.n_vertices : counts.n_normals);
+	DynArray<Face<u16>> faces_u16;
+	DynArray<Face<u32>> faces_u32;
+	switch (index_width) {
+		case IndexWidth::U16:
+			faces_u16 = parse_obj<u16>(obj_source, counts, material_names.slice(), v);
+			break;
+		case IndexWidth::U32:
+			faces_u32 = parse_obj<u32>(obj_source, counts, material_names.slice(), v);
 			break;
-		else
-			todo();
 	}
 
-	return { vec_to_dyn_array(materials), vec_to_dyn_array(vertices), vec_to_dyn_array(normals), vec_to_dyn_array(faces) };
+	return { std::move(materials), std::move(v.vertices), std::move(v.normals), index_width, std::move(faces_u16), std::move(faces_u32) };
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../util/Slice.h"
+
 #include "./Model.h"
 
-Model parse_model(const char* mtl_source, const char* obj_source);
+Model parse_model(Slice<char> mtl_source, Slice<char> obj_source);
@@ -0,0 +1,73 @@
+#include "./Bvh.h"
+
+#include <algorithm> // max, min, nth_element
+#include <cmath> // abs
+
+namespace {
+	// Leaves with a few items are cheaper than descending further.
+	const u32 MAX_LEAF_ITEMS = 4;
+
+	u32 longest_axis(const glm::vec3& extent) {
+		return extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+	}
+}
+
+glm::vec3 Bvh::inverse_direction(const glm::vec3& dir) {
+	glm::vec3 res;
+	for (u32 axis = 0; axis != 3; ++axis)
+		// Huge but finite, so a ray starting on a slab's edge gives 0 instead of NaN.
+		res[axis] = std::abs(dir[axis]) < 1e-20f ? 1e20f : 1.0f / dir[axis];
+	return res;
+}
+
+void Bvh::build(Slice<Bounds> item_bounds) {
+	nodes.clear();
+	items.clear();
+	centers.clear();
+	if (item_bounds.size() == 0)
+		return;
+	for (u32 i = 0; i != item_bounds.size(); ++i) {
+		items.push_back(i);
+		centers.push_back(item_bounds[i].center());
+	}
+	nodes.push_back(BvhNode {});
+	split(item_bounds, 0, 0, item_bounds.size());
+}
+
+void Bvh::split(Slice<Bounds> item_bounds, u32 node, u32 start, u32 count) {
+	Bounds bounds = item_bounds[items[start]];
+	Bounds center_bounds { centers[items[start]], centers[items[start]] };
+	for (u32 i = start + 1; i != start + count; ++i) {
+		bounds = bounds_union(bounds, item_bounds[items[i]]);
+		center_bounds = bounds_union(center_bounds, Bounds { centers[items[i]], centers[items[i]] });
+	}
+	if (count <= MAX_LEAF_ITEMS) {
+		nodes[node] = BvhNode { bounds, start, count };
+		return;
+	}
+
+	// Splitting on centers rather than bounds keeps a few big items from unbalancing the tree.
+	u32 axis = longest_axis(center_bounds.max - center_bounds.min);
+	u32 mid = start + count / 2;
+	std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + start + count, [&](u32 a, u32 b) {
+		return centers[a][axis] < centers[b][axis];
+	});
+	u32 children = static_cast<u32>(nodes.size());
+	nodes.push_back(BvhNode {});
+	nodes.push_back(BvhNode {});
+	nodes[node] = BvhNode { bounds, children, 0 };
+	split(item_bounds, children, start, mid - start);
+	split(item_bounds, children + 1, mid, start + count - mid);
+}
+
+float Bvh::ray_enters(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inv_dir, float max_fraction) {
+	float t_min = 0.0f;
+	float t_max = max_fraction;
+	for (u32 axis = 0; axis != 3; ++axis) {
+		float t0 = (node.bounds.min[axis] - origin[axis]) * inv_dir[axis];
+		float t1 = (node.bounds.max[axis] - origin[axis]) * inv_dir[axis];
+		t_min = std::max(t_min, std::min(t0, t1));
+		t_max = std::min(t_max, std::max(t0, t1));
+	}
+	return t_min <= t_max ? t_min : -1.0f;
+}
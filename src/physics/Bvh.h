@@ -0,0 +1,101 @@
+#pragma once
+
+#include <utility> // swap
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include "../util/assert.h"
+#include "../util/Bounds.h"
+#include "../util/int.h"
+#include "../util/Slice.h"
+
+struct BvhNode {
+	Bounds bounds;
+	// A leaf if `count` is nonzero: then it holds `items[start .. start + count]`.
+	// Otherwise its children are `nodes[start]` and `nodes[start + 1]`.
+	u32 start;
+	u32 count;
+};
+
+/**
+ * Bounding volume hierarchy over any items with bounds, split at the median along the longest axis.
+ * Items are referred to by their index in the slice passed to `build`.
+ */
+class Bvh {
+	std::vector<BvhNode> nodes;
+	std::vector<u32> items;
+	// Scratch space for `build`, kept to reuse its memory.
+	std::vector<glm::vec3> centers;
+
+	// Max depth is about log2(# items); this is far more than enough.
+	static const u32 MAX_STACK = 64;
+
+	void split(Slice<Bounds> item_bounds, u32 node, u32 start, u32 count);
+
+	static glm::vec3 inverse_direction(const glm::vec3& dir);
+	// Fraction along `dir` where the ray enters the node, or a negative number if it misses it before `max_fraction`.
+	static float ray_enters(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inv_dir, float max_fraction);
+
+public:
+	// May be called again to rebuild in place.
+	void build(Slice<Bounds> item_bounds);
+
+	/**
+	 * Calls `cb(item)` for each item whose bounds the segment from `origin` to `origin + dir * max_fraction` may touch, nearest nodes first.
+	 * `cb` may lower `max_fraction` when it finds a hit, which skips nodes beyond it.
+	 */
+	template <typename /*u32 => void*/ Cb>
+	void raycast(const glm::vec3& origin, const glm::vec3& dir, float& max_fraction, Cb cb) const {
+		glm::vec3 inv_dir = inverse_direction(dir);
+		if (nodes.empty() || ray_enters(nodes[0], origin, inv_dir, max_fraction) < 0.0f)
+			return;
+		u32 stack[MAX_STACK];
+		u32 stack_size = 0;
+		stack[stack_size++] = 0;
+		while (stack_size != 0) {
+			const BvhNode& node = nodes[stack[--stack_size]];
+			if (node.count != 0) {
+				for (u32 i = node.start; i != node.start + node.count; ++i)
+					cb(items[i]);
+				continue;
+			}
+			// A hit found since this was pushed may have put it out of reach, so children are tested against the current `max_fraction`.
+			float t0 = ray_enters(nodes[node.start], origin, inv_dir, max_fraction);
+			float t1 = ray_enters(nodes[node.start + 1], origin, inv_dir, max_fraction);
+			u32 near = node.start, far = node.start + 1;
+			if (t1 >= 0.0f && (t0 < 0.0f || t1 < t0)) {
+				std::swap(near, far);
+				std::swap(t0, t1);
+			}
+			check(stack_size + 2 <= MAX_STACK);
+			// Pushed last to be popped first.
+			if (t1 >= 0.0f)
+				stack[stack_size++] = far;
+			if (t0 >= 0.0f)
+				stack[stack_size++] = near;
+		}
+	}
+
+	// Calls `cb(item)` for each item in a leaf overlapping `box`. The item's own bounds may not overlap it.
+	template <typename /*u32 => void*/ Cb>
+	void overlap(const Bounds& box, Cb cb) const {
+		if (nodes.empty())
+			return;
+		u32 stack[MAX_STACK];
+		u32 stack_size = 0;
+		stack[stack_size++] = 0;
+		while (stack_size != 0) {
+			const BvhNode& node = nodes[stack[--stack_size]];
+			if (!bounds_overlap(node.bounds, box))
+				continue;
+			if (node.count != 0) {
+				for (u32 i = node.start; i != node.start + node.count; ++i)
+					cb(items[i]);
+			} else {
+				check(stack_size + 2 <= MAX_STACK);
+				stack[stack_size++] = node.start;
+				stack[stack_size++] = node.start + 1;
+			}
+		}
+	}
+};
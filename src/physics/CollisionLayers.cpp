@@ -0,0 +1,72 @@
+#include "./CollisionLayers.h"
+
+#include <sstream>
+#include <stdexcept> // runtime_error
+
+#include "../util/assert.h"
+#include "../util/io.h"
+#include "../util/string.h"
+
+namespace {
+	// Splits a line into words, skipping blank and comment lines. Returns false at the end of the input.
+	bool next_words(std::istringstream& in, std::vector<std::string>& words) {
+		std::string line;
+		while (std::getline(in, line)) {
+			words.clear();
+			std::istringstream line_in { line };
+			std::string word;
+			while (line_in >> word)
+				words.push_back(word);
+			if (!words.empty() && words[0][0] != '#')
+				return true;
+		}
+		return false;
+	}
+}
+
+CollisionLayers CollisionLayers::parse(Slice<char> source) {
+	std::istringstream in { std::string { source.begin(), source.end() } };
+	std::vector<std::string> names;
+	check(next_words(in, names));
+	u32 n = ulong_to_u32(names.size());
+	check(n <= MAX_COLLISION_LAYERS);
+
+	std::vector<u16> masks;
+	std::vector<std::string> row;
+	for (u32 i = 0; i != n; ++i) {
+		check(next_words(in, row));
+		check(row.size() == n + 1 && row[0] == names[i]);
+		u16 mask = 0;
+		for (u32 j = 0; j != n; ++j) {
+			const std::string& cell = row[j + 1];
+			check(cell == "0" || cell == "1");
+			if (cell == "1")
+				mask = static_cast<u16>(mask | (1u << j));
+		}
+		masks.push_back(mask);
+	}
+	check(!next_words(in, row));
+
+	// rp3d only tests a pair if each one's mask has the other's category, so a one-sided entry would silently do nothing.
+	for (u32 i = 0; i != n; ++i)
+		for (u32 j = 0; j != n; ++j)
+			check(((masks[i] >> j) & 1) == ((masks[j] >> i) & 1));
+
+	return CollisionLayers { std::move(names), std::move(masks) };
+}
+
+CollisionLayer CollisionLayers::layer(const std::string& name) const {
+	for (u32 i = 0; i != n_layers(); ++i)
+		if (names[i] == name)
+			return CollisionLayer { i };
+	// Names come from code, so this is a typo or a layer missing from collision_layers.txt. Say which.
+	throw std::runtime_error { "No collision layer named '" + name + "'" };
+}
+
+const std::string& CollisionLayers::name(CollisionLayer layer) const {
+	return names[layer.index];
+}
+
+CollisionLayers load_collision_layers(const std::string& cwd) {
+	return CollisionLayers::parse(to_slice(read_file(cwd + "/physics/collision_layers.txt")));
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <utility> // move
+#include <vector>
+
+#include "../util/int.h"
+#include "../util/Slice.h"
+
+// rp3d's category and mask bits are 16 bits.
+const u32 MAX_COLLISION_LAYERS = 16;
+
+struct CollisionLayer {
+	u32 index;
+};
+
+/**
+ * Which kinds of bodies can collide with which.
+ * rp3d skips pairs whose layers don't collide before testing their shapes.
+ */
+class CollisionLayers {
+	std::vector<std::string> names;
+	// Bit j of masks[i] is set if layer i collides with layer j. Symmetric.
+	std::vector<u16> masks;
+
+	CollisionLayers(std::vector<std::string> _names, std::vector<u16> _masks) : names{std::move(_names)}, masks{std::move(_masks)} {}
+
+public:
+	/**
+	 * A header line naming each layer, then a row per layer, in the same order, of 1s and 0s for whether it collides with each.
+	 * The matrix must be symmetric. Blank lines and lines starting with '#' are ignored.
+	 */
+	static CollisionLayers parse(Slice<char> source);
+
+	inline u32 n_layers() const {
+		return ulong_to_u32(names.size());
+	}
+
+	CollisionLayer layer(const std::string& name) const;
+	const std::string& name(CollisionLayer layer) const;
+
+	inline u16 category_bits(CollisionLayer layer) const {
+		return static_cast<u16>(1u << layer.index);
+	}
+
+	inline u16 mask_bits(CollisionLayer layer) const {
+		return masks[layer.index];
+	}
+
+	inline bool collide(CollisionLayer a, CollisionLayer b) const {
+		return (mask_bits(a) & category_bits(b)) != 0;
+	}
+};
+
+// Reads `physics/collision_layers.txt`.
+CollisionLayers load_collision_layers(const std::string& cwd);
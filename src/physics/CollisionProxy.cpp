@@ -0,0 +1,117 @@
+#include "./CollisionProxy.h"
+
+#include <algorithm> // max
+#include <cmath> // sqrt
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "../util/Bounds.h"
+
+namespace {
+	const float PI = glm::pi<float>();
+
+	// Sum of signed volumes of tetrahedra from the origin to each face. Only meaningful for a closed mesh.
+	float mesh_volume(const Model& model) {
+		return model.with_faces([&](auto faces) {
+			float six_volume = 0.0f;
+			for (const auto& face : faces)
+				six_volume += glm::dot(model.vertices[face.vertex_0], glm::cross(model.vertices[face.vertex_1], model.vertices[face.vertex_2]));
+			return six_volume / 6.0f;
+		});
+	}
+
+	Transform translation(const glm::vec3& position) {
+		return Transform { position, glm::quat {} };
+	}
+
+	CollisionProxy fit_sphere(Slice<glm::vec3> points, const Bounds& bounds) {
+		glm::vec3 center = bounds.center();
+		float radius = 0.0f;
+		for (const glm::vec3& p : points)
+			radius = std::max(radius, glm::distance(center, p));
+		return CollisionProxy { ProxyKind::Sphere, translation(center), radius, 0.0f, glm::vec3 {}, 0.0f };
+	}
+
+	float sphere_volume(float radius) {
+		return 4.0f / 3.0f * PI * radius * radius * radius;
+	}
+
+	// Along the longest side of the bounding box.
+	CollisionProxy fit_capsule(Slice<glm::vec3> points, const Bounds& bounds) {
+		glm::vec3 half = bounds.half_extents();
+		u32 axis = half.x >= half.y && half.x >= half.z ? 0 : half.y >= half.z ? 1 : 2;
+		glm::vec3 center = bounds.center();
+
+		float radius = 0.0f;
+		for (const glm::vec3& p : points) {
+			glm::vec3 d = p - center;
+			d[axis] = 0.0f;
+			radius = std::max(radius, glm::length(d));
+		}
+		// Then just long enough for every point to be inside one of the caps or between them.
+		float half_height = 0.0f;
+		for (const glm::vec3& p : points) {
+			glm::vec3 d = p - center;
+			float axial = std::abs(d[axis]);
+			d[axis] = 0.0f;
+			float cap = std::sqrt(std::max(0.0f, radius * radius - glm::dot(d, d)));
+			half_height = std::max(half_height, axial - cap);
+		}
+
+		// Turn the capsule's y axis to `axis`.
+		glm::quat rotation = axis == 0 ? glm::angleAxis(-PI / 2.0f, glm::vec3 { 0.0f, 0.0f, 1.0f })
+			: axis == 2 ? glm::angleAxis(PI / 2.0f, glm::vec3 { 1.0f, 0.0f, 0.0f })
+			: glm::quat {};
+		return CollisionProxy { ProxyKind::Capsule, Transform { center, rotation }, radius, half_height, glm::vec3 {}, 0.0f };
+	}
+
+	float capsule_volume(float radius, float half_height) {
+		return PI * radius * radius * 2.0f * half_height + sphere_volume(radius);
+	}
+
+	CollisionProxy fit_box(const Bounds& bounds) {
+		return CollisionProxy { ProxyKind::Box, translation(bounds.center()), 0.0f, 0.0f, bounds.half_extents(), 0.0f };
+	}
+
+	float box_volume(const glm::vec3& half_extents) {
+		return 8.0f * half_extents.x * half_extents.y * half_extents.z;
+	}
+}
+
+const char* proxy_kind_name(ProxyKind kind) {
+	switch (kind) {
+		case ProxyKind::Sphere: return "sphere";
+		case ProxyKind::Capsule: return "capsule";
+		case ProxyKind::Box: return "box";
+		case ProxyKind::ConvexHull: return "convex hull";
+		case ProxyKind::Mesh: return "mesh";
+	}
+}
+
+CollisionProxy choose_collision_proxy(const Model& model, const ConvexHull& hull, float max_volume_excess) {
+	CollisionProxy mesh { ProxyKind::Mesh, translation(glm::vec3 { 0.0f }), 0.0f, 0.0f, glm::vec3 {}, 0.0f };
+	float volume = mesh_volume(model);
+	// A flat or open model has no volume to compare against.
+	if (hull.is_degenerate() || volume <= 0.0f)
+		return mesh;
+
+	// Every model vertex is inside the hull, so fitting to the hull's vertices alone is enough.
+	Slice<glm::vec3> points = hull.vertices.slice();
+	Bounds bounds = point_bounds(points);
+	CollisionProxy sphere = fit_sphere(points, bounds);
+	CollisionProxy capsule = fit_capsule(points, bounds);
+	// rp3d capsules need some length between the caps. Without any, it's a sphere.
+	if (capsule.half_height <= 0.0f)
+		capsule.kind = ProxyKind::Sphere;
+	CollisionProxy box = fit_box(bounds);
+	CollisionProxy convex { ProxyKind::ConvexHull, translation(glm::vec3 { 0.0f }), 0.0f, 0.0f, glm::vec3 {}, 0.0f };
+	sphere.volume_excess = sphere_volume(sphere.radius) / volume - 1.0f;
+	capsule.volume_excess = capsule_volume(capsule.radius, capsule.half_height) / volume - 1.0f;
+	box.volume_excess = box_volume(box.half_extents) / volume - 1.0f;
+	convex.volume_excess = hull.volume() / volume - 1.0f;
+
+	for (const CollisionProxy& proxy : { sphere, capsule, box, convex })
+		if (proxy.volume_excess <= max_volume_excess)
+			return proxy;
+	return mesh;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include "../model/Model.h"
+#include "../util/Transform.h"
+
+#include "./ConvexHull.h"
+
+// In order of increasing narrow-phase cost.
+enum class ProxyKind {
+	Sphere,
+	Capsule,
+	Box,
+	ConvexHull,
+	Mesh,
+};
+
+const char* proxy_kind_name(ProxyKind kind);
+
+// A simpler shape standing in for a model in collision tests.
+struct CollisionProxy {
+	ProxyKind kind;
+	// Where the shape sits in model space. Capsules run along their local y axis, so this also turns them to the model's long axis.
+	Transform local;
+	float radius; // Sphere and Capsule
+	float half_height; // Capsule: from its center to each cap's center.
+	glm::vec3 half_extents; // Box
+	// How much bigger the proxy is than the model, as a fraction of the model's volume. 0 for Mesh.
+	float volume_excess;
+};
+
+// Picks the cheapest proxy whose volume exceeds the model's by at most `max_volume_excess`.
+// Falls back to the mesh itself if nothing is close enough, or if the model isn't closed (so has no volume).
+// `hull` is the model's convex hull, and may be degenerate.
+CollisionProxy choose_collision_proxy(const Model& model, const ConvexHull& hull, float max_volume_excess);
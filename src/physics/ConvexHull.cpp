@@ -0,0 +1,329 @@
+#include "./ConvexHull.h"
+
+#include <cfloat> // FLT_EPSILON
+#include <algorithm> // max
+#include <cmath> // fabs
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <utility> // pair, swap
+#include <vector>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "../util/assert.h"
+#include "../util/Bounds.h"
+
+namespace {
+	struct HullFace {
+		u32 v[3];
+		// In double precision: thin triangles are common on curved surfaces, and their normals are poorly conditioned.
+		glm::dvec3 normal; // Unit length, pointing out.
+		double offset; // dot(normal, p) for any p on the plane.
+		// Points above this face that aren't on the hull yet.
+		std::vector<u32> outside;
+		bool alive;
+	};
+
+	float distance_above(const HullFace& face, const glm::vec3& p) {
+		return static_cast<float>(glm::dot(face.normal, glm::dvec3 { p }) - face.offset);
+	}
+
+	HullFace make_face(Slice<glm::vec3> points, u32 a, u32 b, u32 c) {
+		glm::dvec3 pa { points[a] };
+		glm::dvec3 normal = glm::normalize(glm::cross(glm::dvec3 { points[b] } - pa, glm::dvec3 { points[c] } - pa));
+		return HullFace { { a, b, c }, normal, glm::dot(normal, pa), {}, /*alive*/ true };
+	}
+
+	// Directed edge from `a` to `b`. Each hull edge appears once in each direction, in its 2 faces.
+	u64 edge_key(u32 a, u32 b) {
+		return (static_cast<u64>(a) << 32) | b;
+	}
+
+	// Like Lloyd's quickhull tolerance: a multiple of float error at the scale of the input.
+	float tolerance(Slice<glm::vec3> points) {
+		glm::vec3 max_abs { 0.0f, 0.0f, 0.0f };
+		for (const glm::vec3& p : points)
+			max_abs = glm::max(max_abs, glm::abs(p));
+		return 16.0f * FLT_EPSILON * (max_abs.x + max_abs.y + max_abs.z);
+	}
+
+	float distance_from_line(const glm::vec3& a, const glm::vec3& b, const glm::vec3& p) {
+		return glm::length(glm::cross(b - a, p - a)) / glm::length(b - a);
+	}
+
+	class Quickhull {
+		Slice<glm::vec3> points;
+		float eps;
+		std::vector<HullFace> faces;
+		std::unordered_map<u64, u32> edge_to_face;
+		// Faces that may have outside points. Some may have died since being pushed.
+		std::vector<u32> pending;
+
+	public:
+		Quickhull(Slice<glm::vec3> _points) : points{_points}, eps{tolerance(_points)}, faces{}, edge_to_face{}, pending{} {}
+
+		// Returns false if degenerate.
+		bool run() {
+			if (points.size() < 4 || !initial_tetrahedron())
+				return false;
+			while (!pending.empty()) {
+				u32 face = pending.back();
+				pending.pop_back();
+				if (faces[face].alive && !faces[face].outside.empty() && !add_farthest_point(face))
+					return false;
+			}
+			return true;
+		}
+
+		ConvexHull result() const {
+			std::vector<u32> remap(points.size(), UINT32_MAX);
+			std::vector<glm::vec3> vertices;
+			std::vector<u32> indices;
+			for (const HullFace& face : faces) {
+				if (!face.alive)
+					continue;
+				for (u32 v : face.v) {
+					if (remap[v] == UINT32_MAX) {
+						remap[v] = ulong_to_u32(vertices.size());
+						vertices.push_back(points[v]);
+					}
+					indices.push_back(remap[v]);
+				}
+			}
+			return ConvexHull { vec_to_dyn_array(vertices), vec_to_dyn_array(indices) };
+		}
+
+	private:
+		bool initial_tetrahedron() {
+			// Of the points extreme along some axis, take the 2 farthest apart.
+			u32 extremes[6] = { 0, 0, 0, 0, 0, 0 };
+			for (u32 i = 0; i != points.size(); ++i) {
+				for (u32 axis = 0; axis != 3; ++axis) {
+					if (points[i][axis] < points[extremes[axis * 2]][axis]) extremes[axis * 2] = i;
+					if (points[i][axis] > points[extremes[axis * 2 + 1]][axis]) extremes[axis * 2 + 1] = i;
+				}
+			}
+			u32 a = 0, b = 0;
+			float best = 0.0f;
+			for (u32 i = 0; i != 6; ++i) {
+				for (u32 j = i + 1; j != 6; ++j) {
+					float d = glm::distance(points[extremes[i]], points[extremes[j]]);
+					if (d > best) {
+						best = d;
+						a = extremes[i];
+						b = extremes[j];
+					}
+				}
+			}
+			if (best <= eps)
+				return false;
+
+			u32 c = 0;
+			best = 0.0f;
+			for (u32 i = 0; i != points.size(); ++i) {
+				float d = distance_from_line(points[a], points[b], points[i]);
+				if (d > best) {
+					best = d;
+					c = i;
+				}
+			}
+			if (best <= eps)
+				return false;
+
+			HullFace base = make_face(points, a, b, c);
+			u32 d = 0;
+			best = 0.0f;
+			for (u32 i = 0; i != points.size(); ++i) {
+				float dist = std::fabs(distance_above(base, points[i]));
+				if (dist > best) {
+					best = dist;
+					d = i;
+				}
+			}
+			if (best <= eps)
+				return false;
+
+			// The base must face away from `d`. Each side shares one of its edges, reversed.
+			if (distance_above(base, points[d]) > 0.0f)
+				std::swap(b, c);
+			u32 new_faces[4] = { add_face(a, b, c), add_face(b, a, d), add_face(c, b, d), add_face(a, c, d) };
+			if (edge_to_face.size() != 12)
+				return false;
+
+			std::vector<u32> all;
+			for (u32 i = 0; i != points.size(); ++i)
+				if (i != a && i != b && i != c && i != d)
+					all.push_back(i);
+			assign_outside(all, Slice<u32> { new_faces, 4 });
+			return true;
+		}
+
+		u32 add_face(u32 a, u32 b, u32 c) {
+			u32 index = ulong_to_u32(faces.size());
+			faces.push_back(make_face(points, a, b, c));
+			edge_to_face[edge_key(a, b)] = index;
+			edge_to_face[edge_key(b, c)] = index;
+			edge_to_face[edge_key(c, a)] = index;
+			return index;
+		}
+
+		// Each point goes to the first face it's above; points that aren't above any are inside the hull.
+		void assign_outside(const std::vector<u32>& candidates, Slice<u32> new_faces) {
+			for (u32 p : candidates) {
+				for (u32 f : new_faces) {
+					if (distance_above(faces[f], points[p]) > eps) {
+						faces[f].outside.push_back(p);
+						break;
+					}
+				}
+			}
+			for (u32 f : new_faces)
+				if (!faces[f].outside.empty())
+					pending.push_back(f);
+		}
+
+		bool add_farthest_point(u32 start) {
+			u32 eye = 0;
+			float best = -1.0f;
+			for (u32 p : faces[start].outside) {
+				float d = distance_above(faces[start], points[p]);
+				if (d > best) {
+					best = d;
+					eye = p;
+				}
+			}
+
+			// Flood out from `start` through faces the eye can see. Edges into faces it can't see form the horizon.
+			std::vector<u32> visible { start };
+			std::vector<std::pair<u32, u32>> horizon;
+			faces[start].alive = false;
+			for (u32 i = 0; i != visible.size(); ++i) {
+				const HullFace& face = faces[visible[i]];
+				for (u32 e = 0; e != 3; ++e) {
+					u32 from = face.v[e], to = face.v[(e + 1) % 3];
+					auto found = edge_to_face.find(edge_key(to, from));
+					if (found == edge_to_face.end())
+						return false;
+					HullFace& neighbor = faces[found->second];
+					if (!neighbor.alive)
+						continue; // Already visited
+					if (distance_above(neighbor, points[eye]) > -eps) {
+						neighbor.alive = false;
+						visible.push_back(found->second);
+					} else
+						horizon.push_back({ from, to });
+				}
+			}
+
+			std::vector<u32> orphans;
+			for (u32 f : visible) {
+				HullFace& face = faces[f];
+				for (u32 e = 0; e != 3; ++e)
+					edge_to_face.erase(edge_key(face.v[e], face.v[(e + 1) % 3]));
+				for (u32 p : face.outside)
+					if (p != eye)
+						orphans.push_back(p);
+				face.outside = {};
+			}
+
+			if (horizon.empty())
+				return false;
+			std::vector<u32> cone;
+			for (const std::pair<u32, u32>& edge : horizon) {
+				// Any edge already present means the horizon isn't a simple loop, which only happens through rounding error.
+				u32 a = edge.first, b = edge.second;
+				if (edge_to_face.count(edge_key(a, b)) != 0 || edge_to_face.count(edge_key(b, eye)) != 0 || edge_to_face.count(edge_key(eye, a)) != 0)
+					return false;
+				cone.push_back(add_face(a, b, eye));
+			}
+			assign_outside(orphans, vec_to_slice(cone));
+			return true;
+		}
+	};
+}
+
+float ConvexHull::volume() const {
+	// Sum of signed volumes of tetrahedra from the origin to each triangle.
+	float six_volume = 0.0f;
+	for (u32 i = 0; i != indices.size(); i += 3)
+		six_volume += glm::dot(vertices[indices[i]], glm::cross(vertices[indices[i + 1]], vertices[indices[i + 2]]));
+	return six_volume / 6.0f;
+}
+
+ConvexHull quickhull(Slice<glm::vec3> points) {
+	Quickhull q { points };
+	return q.run() ? q.result() : ConvexHull {};
+}
+
+namespace {
+	// A hull is right if it's closed (each edge is in exactly 2 faces, once each way) and no point is outside any face.
+	void check_hull(const char* name, const std::vector<glm::vec3>& points, float expected_volume) {
+		Slice<glm::vec3> slice { points.data(), ulong_to_u32(points.size()) };
+		ConvexHull hull = quickhull(slice);
+		if (hull.is_degenerate()) {
+			std::cout << name << ": degenerate" << (expected_volume <= 0.0f ? "" : " (WRONG)") << std::endl;
+			return;
+		}
+
+		std::unordered_map<u64, u32> edge_counts;
+		for (u32 i = 0; i != hull.indices.size(); i += 3)
+			for (u32 e = 0; e != 3; ++e)
+				++edge_counts[edge_key(hull.indices[i + e], hull.indices[i + (e + 1) % 3])];
+		bool closed = true;
+		for (const std::pair<const u64, u32>& edge : edge_counts)
+			closed = closed && edge.second == 1 && edge_counts.count((edge.first << 32) | (edge.first >> 32)) == 1;
+
+		// Points left within `tolerance` of a face can add up to a little more at thin triangles. See `quickhull`.
+		Bounds bounds = point_bounds(slice);
+		float allowed_outside = 1e-4f * glm::distance(bounds.min, bounds.max);
+		float max_outside = 0.0f;
+		for (u32 i = 0; i != hull.indices.size(); i += 3) {
+			HullFace face = make_face(hull.vertices.slice(), hull.indices[i], hull.indices[i + 1], hull.indices[i + 2]);
+			for (const glm::vec3& p : points)
+				max_outside = std::max(max_outside, distance_above(face, p));
+		}
+
+		bool ok = closed && max_outside <= allowed_outside && std::fabs(hull.volume() - expected_volume) <= 0.05f * expected_volume;
+		std::cout << name << ": " << hull.vertices.size() << " vertices, " << hull.n_triangles() << " triangles, volume " << hull.volume()
+			<< " (expected " << expected_volume << "), " << (closed ? "closed" : "NOT CLOSED") << ", farthest point outside " << max_outside
+			<< (ok ? "" : " (WRONG)") << std::endl;
+	}
+}
+
+void test_quickhull() {
+	std::mt19937 rng { 1 };
+	std::uniform_real_distribution<float> unit { -1.0f, 1.0f };
+	auto random_point = [&]() { return glm::vec3 { unit(rng), unit(rng), unit(rng) }; };
+
+	// The corners, plus points inside that must be left off.
+	std::vector<glm::vec3> box;
+	for (u32 i = 0; i != 8; ++i)
+		box.push_back(glm::vec3 { i & 1 ? 1.0f : -1.0f, i & 2 ? 2.0f : -2.0f, i & 4 ? 0.5f : -0.5f });
+	for (u32 i = 0; i != 1000; ++i)
+		box.push_back(random_point() * glm::vec3 { 1.0f, 2.0f, 0.5f });
+	check_hull("box", box, 8.0f);
+
+	// Every point is on the hull, and many of its triangles are thin.
+	std::vector<glm::vec3> sphere;
+	for (u32 i = 0; i != 3000; ++i) {
+		glm::vec3 p = random_point();
+		if (glm::length(p) > 0.1f)
+			sphere.push_back(glm::normalize(p) * 2.0f + glm::vec3 { 5.0f, 0.0f, 0.0f });
+	}
+	check_hull("sphere", sphere, 4.0f / 3.0f * 3.14159265f * 8.0f);
+
+	// Lots of coplanar and collinear points.
+	std::vector<glm::vec3> grid;
+	for (u32 x = 0; x != 10; ++x)
+		for (u32 y = 0; y != 10; ++y)
+			for (u32 z = 0; z != 10; ++z)
+				grid.push_back(glm::vec3 { static_cast<float>(x), static_cast<float>(y), static_cast<float>(z) } * 0.1f);
+	check_hull("grid", grid, 0.729f);
+
+	std::vector<glm::vec3> flat;
+	for (u32 i = 0; i != 100; ++i)
+		flat.push_back(glm::vec3 { unit(rng), unit(rng), 0.0f });
+	check_hull("flat", flat, 0.0f);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include "../util/DynArray.h"
+#include "../util/int.h"
+#include "../util/Slice.h"
+
+struct ConvexHull {
+	DynArray<glm::vec3> vertices;
+	// 3 per triangle, counter-clockwise as seen from outside.
+	DynArray<u32> indices;
+
+	inline bool is_degenerate() const {
+		return vertices.size() == 0;
+	}
+
+	inline u32 n_triangles() const {
+		return indices.size() / 3;
+	}
+
+	float volume() const;
+};
+
+// Quickhull. Returns a degenerate hull if the points are (nearly) all on a plane, or too noisy to hull robustly.
+// Points within a small tolerance of the hull are left off it, so it may be that far from convex at thin triangles.
+ConvexHull quickhull(Slice<glm::vec3> points);
+
+// Hulls a few point sets with known answers and prints whether each is closed, contains every point, and has the right volume.
+void test_quickhull();
@@ -1,5 +1,12 @@
 #include "./Physics.h"
 
+#include <algorithm> // find_if, min, sort
+#include <cstddef> // offsetof
+#include <iostream>
+#include <ostream>
+#include <vector>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
 #include <glm/vec3.hpp>
 #include <glm/gtx/quaternion.hpp>
 
@@ -26,6 +33,8 @@
 #pragma clang diagnostic pop
 
 #include "../util/UniquePtr.h"
+#include "./Bvh.h"
+#include "./CollisionProxy.h"
 
 
 namespace {
@@ -56,46 +65,42 @@ namespace {
 
 namespace {
 
-	// Should exist one of these per model.
+	// `triangle_array` points into the Model's vertices and faces, so the Model must outlive it.
 	struct ConcaveMesh {
-		DynArray<float> vertices; //TODO:PERF share with the Model instead of copying?
-		DynArray<int> indices;
 		UniquePtr<rp3d::TriangleVertexArray> triangle_array;
 		UniquePtr<rp3d::TriangleMesh> triangle_mesh;
 		UniquePtr<rp3d::ConcaveMeshShape> shape;//TODO:own
 	};
 
-	ConcaveMesh make_concave_mesh(const Model& model) {
-		Slice<glm::vec3> m_vertices = model.vertices.slice();
-		DynArray<float> vertices = DynArray<float>::uninitialized(m_vertices.size() * 3);
-		uint i = 0;
-		for (const glm::vec3& v : m_vertices) {
-			vertices[i++] = v.x; vertices[i++] = v.y; vertices[i++] = v.z;
-		}
-		assert(i == vertices.size());
-
-		Slice<Face> m_faces = model.faces.slice();
-		uint n_faces = m_faces.size();
-		DynArray<int> indices = DynArray<int>::uninitialized(m_faces.size() * 3);
-		i = 0;
-		// NOTE: Vertices should be specified in counter-clockwise order, as seen from the outside of the mesh.
-		for (const Face& f : m_faces) {
-			indices[i++] = f.vertex_0; indices[i++] = f.vertex_1; indices[i++] = f.vertex_2;
+	rp3d::TriangleVertexArray::IndexDataType index_data_type(IndexWidth width) {
+		switch (width) {
+			case IndexWidth::U16: return rp3d::TriangleVertexArray::IndexDataType::INDEX_SHORT_TYPE;
+			case IndexWidth::U32: return rp3d::TriangleVertexArray::IndexDataType::INDEX_INTEGER_TYPE;
 		}
-		assert(i == indices.size());
+	}
+
+	static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "rp3d reads vertices as 3 packed floats");
+
+	// rp3d reads triangle i's 3 indices from consecutive memory at `start + i * stride`,
+	// so it can read them straight out of the faces, skipping each face's material and normal indices.
+	// Faces are already in the narrowest width rp3d takes: shorts unless the mesh has more than 65536 vertices.
+	// NOTE: Vertices should be specified in counter-clockwise order, as seen from the outside of the mesh.
+	template <typename Index>
+	rp3d::TriangleVertexArray* make_triangle_array(Slice<glm::vec3> vertices, Slice<Face<Index>> faces, IndexWidth width) {
+		static_assert(offsetof(Face<Index>, vertex_1) == offsetof(Face<Index>, vertex_0) + sizeof(Index), "");
+		static_assert(offsetof(Face<Index>, vertex_2) == offsetof(Face<Index>, vertex_1) + sizeof(Index), "");
+		check(faces.size() != 0);
+		return new rp3d::TriangleVertexArray(
+			vertices.size(), vertices.begin(), sizeof(glm::vec3), faces.size(), &faces.begin()->vertex_0, sizeof(Face<Index>),
+			rp3d::TriangleVertexArray::VertexDataType::VERTEX_FLOAT_TYPE, index_data_type(width));
+	}
 
+	ConcaveMesh make_concave_mesh(const Model& model) {
 		ConcaveMesh res {
-			std::move(vertices),
-			std::move(indices),
-			{},
+			UniquePtr { model.with_faces([&](auto faces) { return make_triangle_array(model.vertices.slice(), faces, model.index_width); }) },
 			{},
 			{},
 		};
-
-		res.triangle_array = UniquePtr { new rp3d::TriangleVertexArray(
-			m_vertices.size(), res.vertices.begin(), 3 * sizeof(float), n_faces, res.indices.begin(), 3 * sizeof(int),
-			rp3d::TriangleVertexArray::VertexDataType::VERTEX_FLOAT_TYPE, rp3d::TriangleVertexArray::IndexDataType::INDEX_INTEGER_TYPE), //TODO:PERF use shorts
-		};
 		res.triangle_mesh = UniquePtr { new rp3d::TriangleMesh{} };
 		res.triangle_mesh->addSubpart(res.triangle_array.ptr());
 
@@ -105,42 +110,260 @@ namespace {
 		return res;
 	}
 
-	//NOTE: height field shapes also exist.
+	// A proxy may be this much bigger than its model, as a fraction of the model's volume, before trying the next costlier shape.
+	const float MAX_PROXY_VOLUME_EXCESS = 0.15f;
+
+	// The rp3d shape for a CollisionProxy. Null for ProxyKind::Mesh, which uses the ConcaveMesh's shape.
+	// For ProxyKind::ConvexHull, `polygon_array` points into `hull` and `hull_faces`.
+	struct ProxyShape {
+		CollisionProxy proxy;
+		ConvexHull hull;
+		DynArray<rp3d::PolygonVertexArray::PolygonFace> hull_faces;
+		UniquePtr<rp3d::PolygonVertexArray> polygon_array;
+		UniquePtr<rp3d::PolyhedronMesh> polyhedron_mesh;
+		UniquePtr<rp3d::CollisionShape> shape;
+	};
+
+	ProxyShape make_proxy_shape(const Model& model) {
+		ConvexHull hull = quickhull(model.vertices.slice());
+		CollisionProxy proxy = choose_collision_proxy(model, hull, MAX_PROXY_VOLUME_EXCESS);
+		ProxyShape res { proxy, {}, {}, {}, {}, {} };
+		switch (proxy.kind) {
+			case ProxyKind::Sphere:
+				res.shape = UniquePtr<rp3d::CollisionShape> { new rp3d::SphereShape(proxy.radius) };
+				break;
+			case ProxyKind::Capsule:
+				// rp3d's height is between the caps' centers.
+				res.shape = UniquePtr<rp3d::CollisionShape> { new rp3d::CapsuleShape(proxy.radius, 2.0f * proxy.half_height) };
+				break;
+			case ProxyKind::Box:
+				res.shape = UniquePtr<rp3d::CollisionShape> { new rp3d::BoxShape(vec3_to_rp3d(proxy.half_extents)) };
+				break;
+			case ProxyKind::ConvexHull: {
+				res.hull = std::move(hull);
+				u32 n_triangles = res.hull.n_triangles();
+				res.hull_faces = fill_array<rp3d::PolygonVertexArray::PolygonFace>{}(n_triangles, [](u32 i) {
+					return rp3d::PolygonVertexArray::PolygonFace { 3, i * 3 };
+				});
+				res.polygon_array = UniquePtr { new rp3d::PolygonVertexArray(
+					res.hull.vertices.size(), res.hull.vertices.begin(), sizeof(glm::vec3), res.hull.indices.begin(), 3 * sizeof(u32),
+					n_triangles, res.hull_faces.begin(),
+					rp3d::PolygonVertexArray::VertexDataType::VERTEX_FLOAT_TYPE, rp3d::PolygonVertexArray::IndexDataType::INDEX_INTEGER_TYPE) };
+				res.polyhedron_mesh = UniquePtr { new rp3d::PolyhedronMesh(res.polygon_array.ptr()) };
+				res.shape = UniquePtr<rp3d::CollisionShape> { new rp3d::ConvexMeshShape(res.polyhedron_mesh.ptr()) };
+				break;
+			}
+			case ProxyKind::Mesh:
+				break;
+		}
+		return res;
+	}
+
+	Bvh triangle_bvh(const Model& model) {
+		std::vector<Bounds> triangle_bounds = model.with_faces([&](auto faces) {
+			std::vector<Bounds> res;
+			for (const auto& face : faces) {
+				const glm::vec3& a = model.vertices[face.vertex_0];
+				const glm::vec3& b = model.vertices[face.vertex_1];
+				const glm::vec3& c = model.vertices[face.vertex_2];
+				res.push_back(Bounds { glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)) });
+			}
+			return res;
+		});
+		Bvh res;
+		res.build(vec_to_slice(triangle_bounds));
+		return res;
+	}
 
-	//NOTE: rp3d supports collision filtering, if some objects will only collide with some other objects.
-	// Note: intentionally not using 'enum class' since these should convert to uint.
-	//Note: to work the collision must be specified both ways -- if player specifies hazard, hazard must specify player.
-	namespace CollisionFlags {
-		const uint Player = 0x01;
-		const uint Hazard = 0x02;
-		//const uint SomethingYetMoreElse = 0x04;
+	// Should exist one of these per model.
+	struct ModelCollision {
+		const Model& model;
+		Bounds bounds; // In model space
+		Bvh triangles; // In model space. Items are face indices.
+		ProxyShape proxy;
+		// Only built for ProxyKind::Mesh. (Raycasts test the model's triangles directly.)
+		ConcaveMesh mesh;
+
+		rp3d::CollisionShape* shape() {
+			return proxy.proxy.kind == ProxyKind::Mesh ? mesh.shape.ptr() : proxy.shape.ptr();
+		}
 	};
 
+	// Indexed by ModelKind.
+	void print_proxies(Slice<ModelCollision> models) {
+		std::cout << "Collision proxies:";
+		for (u32 i = 0; i != models.size(); ++i) {
+			const CollisionProxy& proxy = models[i].proxy.proxy;
+			std::cout << (i == 0 ? " " : ", ") << model_kind_name(ModelKind(i)) << " is a " << proxy_kind_name(proxy.kind);
+			if (proxy.kind != ProxyKind::Mesh)
+				std::cout << " (" << proxy.volume_excess * 100.0f << "% bigger)";
+		}
+		std::cout << std::endl;
+	}
+
+	ModelCollision make_model_collision(const Model& model) {
+		ProxyShape proxy = make_proxy_shape(model);
+		ConcaveMesh mesh = proxy.proxy.kind == ProxyKind::Mesh ? make_concave_mesh(model) : ConcaveMesh {};
+		return ModelCollision { model, point_bounds(model.vertices.slice()), triangle_bvh(model), std::move(proxy), std::move(mesh) };
+	}
+
+	struct BodyEntry {
+		rp3d::CollisionBody* body;
+		rp3d::ProxyShape* proxy_shape;
+		u32 model;
+		CollisionLayer layer;
+	};
+
+	// What queries need to know about a body. Read once per batch of queries, so each query doesn't go through rp3d.
+	struct BodySnapshot {
+		rp3d::CollisionBody* body;
+		u32 model;
+		Transform transform;
+		glm::quat inverse_rotation;
+		Bounds world_bounds; // Of the model's bounds, once moved into place
+	};
+
+	Bounds transform_bounds(const Bounds& b, const Transform& t) {
+		glm::vec3 center = t.position + t.quat * b.center();
+		glm::vec3 half = b.half_extents();
+		glm::vec3 world_half = glm::abs(t.quat * glm::vec3 { half.x, 0.0f, 0.0f })
+			+ glm::abs(t.quat * glm::vec3 { 0.0f, half.y, 0.0f })
+			+ glm::abs(t.quat * glm::vec3 { 0.0f, 0.0f, half.z });
+		return Bounds { center - world_half, center + world_half };
+	}
+
+	// Möller-Trumbore. Returns the fraction along `dir` where it hits the front of the triangle, or a negative number if it doesn't.
+	// Like rp3d's concave meshes, triangles are one-sided: the front is counter-clockwise.
+	float ray_triangle(const glm::vec3& origin, const glm::vec3& dir, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+		glm::vec3 e1 = b - a;
+		glm::vec3 e2 = c - a;
+		glm::vec3 p = glm::cross(dir, e2);
+		float det = glm::dot(e1, p);
+		if (det <= 0.0f)
+			return -1.0f; // From behind, or parallel
+		glm::vec3 s = origin - a;
+		float u = glm::dot(s, p);
+		if (u < 0.0f || u > det)
+			return -1.0f;
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(dir, q);
+		if (v < 0.0f || u + v > det)
+			return -1.0f;
+		return glm::dot(e2, q) / det;
+	}
+
+	// `body_bvh` is over the bodies' world bounds, and each model's `triangles` over its faces, so a ray only visits what's near it.
+	RayHit raycast_one(Slice<ModelCollision> models, Slice<BodySnapshot> bodies, const Bvh& body_bvh, const RayQuery& ray) {
+		RayHit hit { 1.0f, glm::vec3 {}, glm::vec3 {}, 0, nullptr };
+		glm::vec3 world_dir = ray.to - ray.from;
+		body_bvh.raycast(ray.from, world_dir, hit.hit_fraction, [&](u32 body_index) {
+			const BodySnapshot& body = bodies[body_index];
+			// Rotations keep lengths, so fractions along the ray are the same in model space.
+			glm::vec3 origin = body.inverse_rotation * (ray.from - body.transform.position);
+			glm::vec3 dir = body.inverse_rotation * world_dir;
+			const ModelCollision& collision = models[body.model];
+			const Model& model = collision.model;
+			model.with_faces([&](auto faces) {
+				collision.triangles.raycast(origin, dir, hit.hit_fraction, [&](u32 i) {
+					const auto& face = faces[i];
+					const glm::vec3& a = model.vertices[face.vertex_0];
+					const glm::vec3& b = model.vertices[face.vertex_1];
+					const glm::vec3& c = model.vertices[face.vertex_2];
+					float t = ray_triangle(origin, dir, a, b, c);
+					if (t >= 0.0f && t <= hit.hit_fraction) {
+						hit.hit_fraction = t;
+						hit.world_normal = body.transform.quat * glm::normalize(glm::cross(b - a, c - a));
+						hit.triangle_index = i;
+						hit.body = body.body;
+					}
+				});
+			});
+		});
+		if (hit.body != nullptr)
+			hit.world_point = ray.from + world_dir * hit.hit_fraction;
+		return hit;
+	}
+
+	OverlapResult overlap_one(Slice<BodySnapshot> bodies, const Bvh& body_bvh, const AabbQuery& query) {
+		OverlapResult res;
+		res.n_bodies = 0;
+		Bounds box { query.min, query.max };
+		body_bvh.overlap(box, [&](u32 body_index) {
+			const BodySnapshot& body = bodies[body_index];
+			if (!bounds_overlap(box, body.world_bounds))
+				return;
+			if (res.n_bodies < MAX_OVERLAPS_PER_QUERY)
+				res.bodies[res.n_bodies] = body.body;
+			++res.n_bodies;
+		});
+		return res;
+	}
+
+	// Enough queries per task to outweigh handing out the task.
+	const u32 QUERIES_PER_TASK = 64;
+
+	// Calls `cb(i)` for each i in 0..n, spread over the pool.
+	template <typename Cb>
+	void parallel_queries(ThreadPool& thread_pool, u32 n, Cb cb) {
+		thread_pool.parallel_for((n + QUERIES_PER_TASK - 1) / QUERIES_PER_TASK, [&](u32 task) {
+			u32 end = std::min(n, (task + 1) * QUERIES_PER_TASK);
+			for (u32 i = task * QUERIES_PER_TASK; i != end; ++i)
+				cb(i);
+		});
+	}
+
+	// rp3d doesn't report its broad phase, so this redoes it on the world bounds of each body's shape: sort by min x, then sweep.
+	// `bounds` and `order` are scratch space, kept to reuse their memory.
+	void count_pairs(const std::vector<BodyEntry>& bodies, const CollisionLayers& layers, std::vector<Bounds>& bounds, std::vector<u32>& order, CollisionStats& stats) {
+		bounds.clear();
+		order.clear();
+		for (u32 i = 0; i != bodies.size(); ++i) {
+			rp3d::AABB aabb = bodies[i].proxy_shape->getWorldAABB();
+			bounds.push_back(Bounds { vec3_from_rp3d(aabb.getMin()), vec3_from_rp3d(aabb.getMax()) });
+			order.push_back(i);
+		}
+		std::sort(order.begin(), order.end(), [&](u32 a, u32 b) { return bounds[a].min.x < bounds[b].min.x; });
+		for (u32 i = 0; i != order.size(); ++i) {
+			const Bounds& a = bounds[order[i]];
+			for (u32 j = i + 1; j != order.size() && bounds[order[j]].min.x <= a.max.x; ++j) {
+				if (!bounds_overlap(a, bounds[order[j]]))
+					continue;
+				++stats.broad_phase_pairs;
+				if (layers.collide(bodies[order[i]].layer, bodies[order[j]].layer))
+					++stats.narrow_phase_tests;
+			}
+		}
+	}
 
-	rp3d::Transform transform_identity() { return rp3d::Transform { rp3d::Vector3 { 0.0, 0.0, 0.0 }, rp3d::Quaternion::identity() }; }
+	double per_collect(u64 count, u64 n_collects) {
+		return static_cast<double>(count) / static_cast<double>(n_collects);
+	}
+
+	//NOTE: height field shapes also exist.
+
+	// Copies every contact point out of rp3d's lists, so the game can read them as flat arrays.
+	class ContactCollector final : public rp3d::CollisionCallback {
+		Contacts& out;
+
+	public:
+		u64 n_pairs;
+
+		explicit ContactCollector(Contacts& _out) : out{_out}, n_pairs{0} {}
 
-	class MyCollisionCallback final : public rp3d::CollisionCallback {
 		void notifyContact(const CollisionCallbackInfo& info) override {
-			//info.body1;
-			//info.body2;
-			//info.proxyShape1;
-			//info.proxyShape2;
-			//this is a linked list
+			++n_pairs;
+			// Both the manifolds and each manifold's points are linked lists.
 			for (rp3d::ContactManifoldListElement* list_ptr = info.contactManifoldElements; list_ptr != nullptr; list_ptr = list_ptr->getNext()) {
-				//do useful stuff
 				rp3d::ContactManifold* manifold = list_ptr->getContactManifold();
-				manifold->getBody1();
-				manifold->getBody2();
-				manifold->getShape1();
-				manifold->getShape2();
-				rp3d::ContactPoint* begin_contact_points = manifold->getContactPoints();
-				uint n_contact_points = int_to_uint(manifold->getNbContactPoints());
-				for (uint i = 0; i != n_contact_points; ++i) {
-					const rp3d::ContactPoint& point = begin_contact_points[i];
-					point.getNormal();
-					point.getLocalPointOnShape1();
-					point.getLocalPointOnShape2();
-					point.getIsRestingContact();
+				PhysicsBodyId body_1 = manifold->getBody1()->getID();
+				PhysicsBodyId body_2 = manifold->getBody2()->getID();
+				for (rp3d::ContactPoint* point = manifold->getContactPoints(); point != nullptr; point = point->getNext()) {
+					out.body_1.push_back(body_1);
+					out.body_2.push_back(body_2);
+					out.normal.push_back(vec3_from_rp3d(point->getNormal()));
+					out.penetration.push_back(point->getPenetrationDepth());
+					out.local_point_1.push_back(vec3_from_rp3d(point->getLocalPointOnShape1()));
+					out.local_point_2.push_back(vec3_from_rp3d(point->getLocalPointOnShape2()));
 				}
 			}
 		}
@@ -196,34 +419,135 @@ namespace {
 	}*/
 }
 
+
 struct PhysicsImpl {
+	ThreadPool& thread_pool;
+	// Declared before `world` so that shapes outlive the bodies using them.
+	DynArray<ModelCollision> models; // length is # of models
+	CollisionLayers layers;
 	rp3d::CollisionWorld world;
-	DynArray<ConcaveMesh> meshes; // length is # of models
+	std::vector<BodyEntry> bodies;
+	// Rebuilt for each batch of queries. Kept to reuse its memory.
+	std::vector<BodySnapshot> snapshot;
+	// Broad phase for queries, over `snapshot`'s world bounds.
+	std::vector<Bounds> snapshot_bounds;
+	Bvh body_bvh;
+	bool collect_stats;
+	// Scratch space for `count_pairs`.
+	std::vector<Bounds> sweep_bounds;
+	std::vector<u32> sweep_order;
+	CollisionStats stats;
+
+	Slice<BodySnapshot> take_snapshot() {
+		snapshot.clear();
+		for (const BodyEntry& entry : bodies) {
+			Transform transform = transform_from_rp3d(entry.body->getTransform());
+			snapshot.push_back(BodySnapshot {
+				entry.body, entry.model, transform, glm::conjugate(transform.quat), transform_bounds(models[entry.model].bounds, transform) });
+		}
+		return Slice<BodySnapshot> { snapshot.data(), ulong_to_u32(snapshot.size()) };
+	}
+
+	// Rebuilt for each batch, since bodies may have moved. That's n log n in the bodies, much less than the queries save.
+	const Bvh& build_body_bvh() {
+		snapshot_bounds.clear();
+		for (const BodySnapshot& body : snapshot)
+			snapshot_bounds.push_back(body.world_bounds);
+		body_bvh.build(Slice<Bounds> { snapshot_bounds.data(), ulong_to_u32(snapshot_bounds.size()) });
+		return body_bvh;
+	}
 };
 
-Physics::Physics(Slice<Model> models) {
-	impl = new PhysicsImpl { rp3d::CollisionWorld {},  map<ConcaveMesh>{}(models, make_concave_mesh) };
+Physics::Physics(Slice<Model> models, CollisionLayers layers, ThreadPool& thread_pool) {
+	// Each model only builds its own rp3d objects (its hull, and for meshes, the BVH), so these can be built in parallel.
+	DynArray<ModelCollision> collisions = parallel_fill_array<ModelCollision>{thread_pool}(models.size(), [&](u32 i) {
+		return make_model_collision(models[i]);
+	});
+	print_proxies(collisions.slice());
+	impl = new PhysicsImpl { thread_pool, std::move(collisions), std::move(layers), rp3d::CollisionWorld {}, {}, {}, {}, {}, /*collect_stats*/ false, {}, {}, CollisionStats { 0, 0, 0, 0 } };
 }
 
 Physics::~Physics() {
 	delete impl;
 }
 
-Ref<rp3d::CollisionBody> Physics::add_body(ModelKind model, const Transform& transform) {
+Ref<rp3d::CollisionBody> Physics::add_body(ModelKind model, CollisionLayer layer, const Transform& transform) {
+	check(layer.index < impl->layers.n_layers());
 	rp3d::CollisionBody* body = impl->world.createCollisionBody(transform_to_rp3d(transform));
 
-	rp3d::ProxyShape* proxy_shape = body->addCollisionShape(impl->meshes[model_kind_to_u32(model)].shape.ptr(), transform_identity());
-	//TODO
-	proxy_shape->setCollisionCategoryBits(CollisionFlags::Player);
-	proxy_shape->setCollideWithMaskBits(CollisionFlags::Player | CollisionFlags::Hazard);
+	ModelCollision& collision = impl->models[model_kind_to_u32(model)];
+	rp3d::ProxyShape* proxy_shape = body->addCollisionShape(collision.shape(), transform_to_rp3d(collision.proxy.proxy.local));
+	impl->bodies.push_back(BodyEntry { body, proxy_shape, model_kind_to_u32(model), layer });
+	// rp3d tests a pair only if each one's mask has the other's category. The layer matrix is symmetric, so that's the same as either one.
+	proxy_shape->setCollisionCategoryBits(impl->layers.category_bits(layer));
+	proxy_shape->setCollideWithMaskBits(impl->layers.mask_bits(layer));
 
 	return Ref { body };
 }
 
 void Physics::remove_body(Ref<rp3d::CollisionBody> body) {
+	std::vector<BodyEntry>& bodies = impl->bodies;
+	auto found = std::find_if(bodies.begin(), bodies.end(), [&](const BodyEntry& entry) { return entry.body == body.ptr(); });
+	check(found != bodies.end());
+	*found = bodies.back();
+	bodies.pop_back();
 	impl->world.destroyCollisionBody(body.ptr());
 }
 
 Transform Physics::get_transform(Ref<rp3d::CollisionBody> body) {
 	return transform_from_rp3d(body->getTransform());
 }
+
+void Physics::collect_contacts(Contacts& out) {
+	out.clear();
+	ContactCollector collector { out };
+	impl->world.testCollision(&collector);
+
+	if (impl->collect_stats) {
+		CollisionStats& stats = impl->stats;
+		++stats.n_collects;
+		stats.contact_pairs += collector.n_pairs;
+		count_pairs(impl->bodies, impl->layers, impl->sweep_bounds, impl->sweep_order, stats);
+	}
+}
+
+void Physics::set_collect_stats(bool collect) {
+	impl->collect_stats = collect;
+}
+
+const CollisionLayers& Physics::layers() const {
+	return impl->layers;
+}
+
+const CollisionStats& Physics::collision_stats() const {
+	return impl->stats;
+}
+
+void Physics::reset_collision_stats() {
+	impl->stats = CollisionStats { 0, 0, 0, 0 };
+}
+
+void Physics::print_collision_stats(std::ostream& out) const {
+	const CollisionStats& s = impl->stats;
+	if (s.n_collects == 0)
+		return;
+	out << "Per collect_contacts, over " << s.n_collects << ": " << per_collect(s.broad_phase_pairs, s.n_collects) << " broad-phase pairs, "
+		<< per_collect(s.narrow_phase_tests, s.n_collects) << " narrow-phase tests (the layer matrix culled "
+		<< per_collect(s.broad_phase_pairs - s.narrow_phase_tests, s.n_collects) << "), "
+		<< per_collect(s.contact_pairs, s.n_collects) << " pairs touching" << std::endl;
+}
+
+void Physics::raycast(Slice<RayQuery> rays, MutableSlice<RayHit> hits) {
+	check(hits.size() == rays.size());
+	Slice<ModelCollision> models = impl->models.slice();
+	Slice<BodySnapshot> bodies = impl->take_snapshot();
+	const Bvh& body_bvh = impl->build_body_bvh();
+	parallel_queries(impl->thread_pool, rays.size(), [&](u32 i) { hits[i] = raycast_one(models, bodies, body_bvh, rays[i]); });
+}
+
+void Physics::overlap(Slice<AabbQuery> boxes, MutableSlice<OverlapResult> results) {
+	check(results.size() == boxes.size());
+	Slice<BodySnapshot> bodies = impl->take_snapshot();
+	const Bvh& body_bvh = impl->build_body_bvh();
+	parallel_queries(impl->thread_pool, boxes.size(), [&](u32 i) { results[i] = overlap_one(bodies, body_bvh, boxes[i]); });
+}
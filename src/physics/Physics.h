@@ -1,14 +1,87 @@
 #pragma once
 
+#include <iosfwd>
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include "../util/MutableSlice.h"
 #include "../util/Transform.h"
 #include "../util/Ref.h"
+#include "../util/ThreadPool.h"
 
 #include "../model/Model.h"
 #include "../model/ModelKind.h"
 
+#include "./CollisionLayers.h"
+
 namespace reactphysics3d { class CollisionBody; }
 
 using PhysicsBody = reactphysics3d::CollisionBody;
+// rp3d's `CollisionBody::getID`.
+using PhysicsBodyId = u64;
+
+// Contact points between bodies, as parallel arrays: point i is between bodies body_1[i] and body_2[i], and so on.
+// Vectors keep their capacity when cleared, so once they've grown to fit a busy frame, collecting allocates nothing.
+struct Contacts {
+	std::vector<PhysicsBodyId> body_1;
+	std::vector<PhysicsBodyId> body_2;
+	std::vector<glm::vec3> normal; // In world space, from body 1 to body 2
+	std::vector<float> penetration;
+	// Each in the space of that body's collision shape.
+	std::vector<glm::vec3> local_point_1;
+	std::vector<glm::vec3> local_point_2;
+
+	inline u32 size() const {
+		return ulong_to_u32(body_1.size());
+	}
+
+	inline void clear() {
+		body_1.clear();
+		body_2.clear();
+		normal.clear();
+		penetration.clear();
+		local_point_1.clear();
+		local_point_2.clear();
+	}
+};
+
+struct RayQuery {
+	glm::vec3 from;
+	glm::vec3 to;
+};
+
+// The closest hit along a ray. If it hit nothing, `body` is null and the rest is unset.
+struct RayHit {
+	float hit_fraction; // 0 at `from`, 1 at `to`
+	glm::vec3 world_point;
+	glm::vec3 world_normal; // Of the triangle
+	u32 triangle_index; // Into the model's faces
+	PhysicsBody* body;
+};
+
+struct AabbQuery {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+const u32 MAX_OVERLAPS_PER_QUERY = 8;
+
+struct OverlapResult {
+	// Every body whose bounds overlap counts, but only the first MAX_OVERLAPS_PER_QUERY are stored. In no particular order.
+	u32 n_bodies;
+	PhysicsBody* bodies[MAX_OVERLAPS_PER_QUERY];
+};
+
+// Totals since the last `reset_collision_stats`, for tuning the layer matrix. Only collected after `set_collect_stats(true)`.
+struct CollisionStats {
+	u64 n_collects; // Calls to `collect_contacts`
+	// Pairs of bodies whose collision shapes' world bounds overlap. (rp3d's broad phase enlarges them slightly, so it sees a few more.)
+	u64 broad_phase_pairs;
+	// Of those, pairs whose layers collide. rp3d tests the shapes of only these.
+	u64 narrow_phase_tests;
+	// Of those, pairs that were touching.
+	u64 contact_pairs;
+};
 
 struct PhysicsImpl;
 
@@ -16,11 +89,34 @@ class Physics {
 	PhysicsImpl* impl;
 
 public:
-	Physics(Slice<Model> models);
+	// Collision shapes and queries read the models' vertices and faces in place, so `models` must outlive this.
+	// So must `thread_pool`, which queries run on.
+	Physics(Slice<Model> models, CollisionLayers layers, ThreadPool& thread_pool);
 	Physics(const Physics& other) = delete;
 	~Physics();
 
-	Ref<PhysicsBody> add_body(ModelKind model, const Transform& transform);
+	const CollisionLayers& layers() const;
+
+	Ref<PhysicsBody> add_body(ModelKind model, CollisionLayer layer, const Transform& transform);
 	void remove_body(Ref<PhysicsBody> body);
 	Transform get_transform(Ref<PhysicsBody> body);
+
+	// Replaces `out` with every contact point in the world now. Pass the same `out` each frame to reuse its memory.
+	void collect_contacts(Contacts& out);
+	// Off by default, since it redoes rp3d's broad phase on every `collect_contacts`.
+	void set_collect_stats(bool collect);
+	// Updated by `collect_contacts`.
+	const CollisionStats& collision_stats() const;
+	void reset_collision_stats();
+	// Averages per `collect_contacts`.
+	void print_collision_stats(std::ostream& out) const;
+
+	// These fill one result per query, spreading the queries across the thread pool.
+	// They don't go through rp3d (whose queries allocate from the world's memory pool), so they're safe to run in parallel,
+	// but bodies mustn't be added, removed, or moved during a call.
+
+	// Tests against the models' triangles, which are one-sided: a ray from inside a model passes out through it.
+	void raycast(Slice<RayQuery> rays, MutableSlice<RayHit> hits);
+	// Tests against each body's bounding box: its model's bounds, moved into place.
+	void overlap(Slice<AabbQuery> boxes, MutableSlice<OverlapResult> results);
 };
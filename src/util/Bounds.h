@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+
+#include "./Slice.h"
+
+// Axis-aligned box.
+struct Bounds {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	glm::vec3 half_extents() const { return (max - min) * 0.5f; }
+};
+
+inline bool bounds_overlap(const Bounds& a, const Bounds& b) {
+	return a.min.x <= b.max.x && b.min.x <= a.max.x
+		&& a.min.y <= b.max.y && b.min.y <= a.max.y
+		&& a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+inline Bounds bounds_union(const Bounds& a, const Bounds& b) {
+	return Bounds { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+// `points` must be non-empty.
+inline Bounds point_bounds(Slice<glm::vec3> points) {
+	Bounds res { points[0], points[0] };
+	for (const glm::vec3& p : points) {
+		res.min = glm::min(res.min, p);
+		res.max = glm::max(res.max, p);
+	}
+	return res;
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <new>
+#include <type_traits>
+#include <utility> // forward
 #include <vector>
 
 #include "./MutableSlice.h"
@@ -9,30 +11,56 @@
 template <typename T>
 class DynArray {
 	MutableSlice<T> _slice;
+	bool _owned; // False if borrowed: then someone else frees the memory.
 
-	DynArray(T* begin, u32 size) : _slice{begin, size} {}
+	DynArray(T* begin, u32 size, bool owned) : _slice{begin, size}, _owned{owned} {}
 
 	// uninitialized
-	DynArray(u32 size) : DynArray{static_cast<T*>(::operator new(sizeof(T) *  size)), size} {
+	DynArray(u32 size) : DynArray{static_cast<T*>(::operator new(sizeof(T) *  size)), size, /*owned*/ true} {
 		check(size != 0);
 	}
 
+	// Borrowed memory is not ours to destroy.
+	void destroy() {
+		if (!_owned) return;
+		if constexpr (!std::is_trivially_destructible_v<T>)
+			for (T& t : _slice)
+				t.~T();
+		::operator delete(_slice.begin());
+	}
+
 public:
-	DynArray() : _slice{} {}
+	DynArray() : _slice{}, _owned{true} {}
+	// Used by FillGuard when filling an `uninitialized` array failed partway.
+	// Destroys only the slots that were constructed, frees the memory, and leaves this empty.
+	void abandon(Slice<bool> constructed) {
+		check(_owned && constructed.size() == size());
+		if constexpr (!std::is_trivially_destructible_v<T>)
+			for (u32 i = 0; i != size(); ++i)
+				if (constructed[i])
+					_slice[i].~T();
+		::operator delete(_slice.begin());
+		_slice = MutableSlice<T> {};
+	}
 	inline static DynArray<T> uninitialized(u32 len) { return DynArray { len }; }
+	// Memory must outlive the DynArray. (Used for arrays that live in a memory-mapped file.)
+	inline static DynArray<T> borrow(MutableSlice<T> slice) { return DynArray { slice.begin(), slice.size(), /*owned*/ false }; }
 	//DynArray(const DynArray& other __attribute__((unused))) : _slice{} {
 	//	todo(); // should be optimized away!
 	//}
 	void operator=(DynArray&& other) {
-		::operator delete(_slice.begin());
+		destroy();
 		_slice = other._slice;
+		_owned = other._owned;
 		other._slice = MutableSlice<T> {};
+		other._owned = true;
 	}
-	DynArray(DynArray&& other) : _slice{other._slice} {
+	DynArray(DynArray&& other) : _slice{other._slice}, _owned{other._owned} {
 		other._slice = MutableSlice<T> {};
+		other._owned = true;
 	}
 	~DynArray() {
-		::operator delete(_slice.begin());
+		destroy();
 	}
 
 	//TODO:KILL?
@@ -61,13 +89,53 @@ public:
 	inline u32 size() const { return _slice.size(); }
 };
 
+/**
+ * Constructs the slots of an `uninitialized` DynArray, remembering which are done.
+ * If it's destroyed before `finish` (because filling threw), it destroys just those slots, so unwinding never runs `~T` on raw memory.
+ * Different slots may be constructed from different threads.
+ */
+template <typename T>
+class FillGuard {
+	DynArray<T>& array;
+	DynArray<bool> constructed;
+	bool finished;
+
+public:
+	explicit FillGuard(DynArray<T>& _array) : array{_array}, constructed{DynArray<bool>::uninitialized(_array.size())}, finished{false} {
+		for (bool& b : constructed)
+			b = false;
+	}
+	FillGuard(const FillGuard& other) = delete;
+
+	~FillGuard() {
+		if (!finished)
+			array.abandon(constructed.slice());
+	}
+
+	template <typename... Args>
+	void construct(u32 i, Args&&... args) {
+		check(!constructed[i]);
+		new (&array[i]) T { std::forward<Args>(args)... };
+		constructed[i] = true;
+	}
+
+	// Call once every slot is constructed.
+	void finish() {
+		for (bool b : constructed)
+			check(b);
+		finished = true;
+	}
+};
+
 template <typename T>
 struct fill_array {
 	template <typename Cb>
 	DynArray<T> operator()(u32 size, Cb cb) {
 		DynArray<T> out = DynArray<T>::uninitialized(size);
+		FillGuard<T> guard { out };
 		for (u32 i = 0; i != size; ++i)
-			new (&out[i]) T { cb(i) };
+			guard.construct(i, cb(i));
+		guard.finish();
 		return out;
 	}
 };
@@ -78,8 +146,10 @@ struct map {
 	template <typename In, typename /*const In& => Out*/ Cb>
 	DynArray<Out> operator()(const Slice<In>& slice, Cb cb) {
 		DynArray<Out> out = DynArray<Out>::uninitialized(slice.size());
+		FillGuard<Out> guard { out };
 		for (u32 i = 0; i != slice.size(); ++i)
-			new (&out[i]) Out { cb(slice[i]) };
+			guard.construct(i, cb(slice[i]));
+		guard.finish();
 		return out;
 	}
 };
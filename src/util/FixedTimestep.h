@@ -0,0 +1,51 @@
+#pragma once
+
+#include "./assert.h"
+#include "./int.h"
+
+/**
+ * Runs a simulation at a fixed rate, however often (or rarely) frames are drawn.
+ * Each frame, `advance` takes the real time that passed and returns how many steps to run.
+ * What's left over is `alpha`: how far the present is between the last two steps, for interpolating them.
+ */
+class FixedTimestep {
+	u64 step_ns;
+	// If more steps than this are due at once (after a stall, or if steps take longer than they simulate),
+	// the rest of the time is dropped, so the simulation runs slow instead of falling further behind each frame.
+	u32 max_steps_per_frame;
+	u64 accumulated_ns;
+	u64 _dropped_ns;
+
+public:
+	FixedTimestep(u32 steps_per_second, u32 _max_steps_per_frame)
+		: step_ns{1000000000 / steps_per_second}, max_steps_per_frame{_max_steps_per_frame}, accumulated_ns{0}, _dropped_ns{0} {
+		check(steps_per_second != 0 && max_steps_per_frame != 0);
+	}
+
+	u32 advance(u64 elapsed_ns) {
+		accumulated_ns += elapsed_ns;
+		u64 n_steps = accumulated_ns / step_ns;
+		if (n_steps > max_steps_per_frame) {
+			u64 dropped = (n_steps - max_steps_per_frame) * step_ns;
+			_dropped_ns += dropped;
+			accumulated_ns -= dropped;
+			n_steps = max_steps_per_frame;
+		}
+		accumulated_ns -= n_steps * step_ns;
+		return static_cast<u32>(n_steps);
+	}
+
+	// In [0, 1). 0 means the present is exactly at the last step.
+	float alpha() const {
+		return static_cast<float>(accumulated_ns) / static_cast<float>(step_ns);
+	}
+
+	float step_seconds() const {
+		return static_cast<float>(step_ns) / 1e9f;
+	}
+
+	// Total time the simulation has fallen behind real time.
+	u64 dropped_ns() const {
+		return _dropped_ns;
+	}
+};
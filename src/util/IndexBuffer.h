@@ -0,0 +1,59 @@
+#pragma once
+
+#include <limits>
+
+#include "./DynArray.h"
+#include "./int.h"
+
+enum class IndexWidth { U16, U32 };
+
+// Narrowest width that can index `n_indexed` elements.
+inline IndexWidth index_width_for(u32 n_indexed) {
+	return n_indexed <= u32(std::numeric_limits<u16>::max()) + 1 ? IndexWidth::U16 : IndexWidth::U32;
+}
+
+inline u32 index_width_bytes(IndexWidth width) {
+	switch (width) {
+		case IndexWidth::U16: return sizeof(u16);
+		case IndexWidth::U32: return sizeof(u32);
+	}
+}
+
+/** A list of indices stored in the narrowest width that fits. Only the array matching `width` is non-empty. */
+struct IndexBuffer {
+	IndexWidth width;
+	DynArray<u16> u16s;
+	DynArray<u32> u32s;
+
+	inline u32 size() const {
+		return width == IndexWidth::U16 ? u16s.size() : u32s.size();
+	}
+
+	inline u32 size_bytes() const {
+		return size() * index_width_bytes(width);
+	}
+
+	inline const void* data() const {
+		return width == IndexWidth::U16 ? static_cast<const void*>(u16s.begin()) : static_cast<const void*>(u32s.begin());
+	}
+
+	// Calls `cb` with a Slice<u16> or a Slice<u32>.
+	template <typename Cb>
+	auto with_indices(Cb cb) const {
+		return width == IndexWidth::U16 ? cb(u16s.slice()) : cb(u32s.slice());
+	}
+};
+
+inline IndexBuffer to_index_buffer(DynArray<u16>&& u16s) {
+	return IndexBuffer { IndexWidth::U16, std::move(u16s), {} };
+}
+inline IndexBuffer to_index_buffer(DynArray<u32>&& u32s) {
+	return IndexBuffer { IndexWidth::U32, {}, std::move(u32s) };
+}
+
+// Stores `u32s` as u16 if every index is below `n_indexed` and that fits.
+inline IndexBuffer to_narrowest_index_buffer(DynArray<u32>&& u32s, u32 n_indexed) {
+	if (index_width_for(n_indexed) == IndexWidth::U32)
+		return to_index_buffer(std::move(u32s));
+	return to_index_buffer(map<u16>{}(u32s.slice(), [](u32 i) { return u32_to_u16(i); }));
+}
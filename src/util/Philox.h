@@ -0,0 +1,47 @@
+#pragma once
+
+#include "./int.h"
+
+// Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+// Output is a pure function of (counter, key), so any sample can be generated independently on any thread.
+
+struct PhiloxKey {
+	u32 k0;
+	u32 k1;
+};
+
+inline PhiloxKey philox_key(u64 seed) {
+	return PhiloxKey { static_cast<u32>(seed), static_cast<u32>(seed >> 32) };
+}
+
+struct PhiloxBlock {
+	u32 x0;
+	u32 x1;
+	u32 x2;
+	u32 x3;
+};
+
+inline PhiloxBlock philox4x32_10(PhiloxBlock ctr, PhiloxKey key) {
+	const u32 M0 = 0xD2511F53;
+	const u32 M1 = 0xCD9E8D57;
+	const u32 W0 = 0x9E3779B9;
+	const u32 W1 = 0xBB67AE85;
+	for (u32 round = 0; round != 10; ++round) {
+		u64 p0 = u64(M0) * ctr.x0;
+		u64 p1 = u64(M1) * ctr.x2;
+		ctr = PhiloxBlock {
+			static_cast<u32>(p1 >> 32) ^ ctr.x1 ^ key.k0,
+			static_cast<u32>(p1),
+			static_cast<u32>(p0 >> 32) ^ ctr.x3 ^ key.k1,
+			static_cast<u32>(p0),
+		};
+		key.k0 += W0;
+		key.k1 += W1;
+	}
+	return ctr;
+}
+
+// Uniform in [0, 1). Uses the top 24 bits, which is all a float can hold.
+inline float u32_to_unit_float(u32 u) {
+	return static_cast<float>(u >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm> // copy, max, nth_element
+#include <cmath> // ceil
+
+#include "./assert.h"
+#include "./int.h"
+
+/**
+ * Durations (or any positive counts) of the last WINDOW samples.
+ * Percentiles are exact, and cheap enough at this size to select from a copy of the window each time.
+ */
+class RollingHistogram {
+public:
+	static constexpr u32 WINDOW = 256;
+
+private:
+	u64 samples[WINDOW];
+	u32 n_samples;
+	u32 next; // Oldest sample, once the window is full.
+	u64 sum;
+
+public:
+	RollingHistogram() : samples{}, n_samples{0}, next{0}, sum{0} {}
+
+	void add(u64 value) {
+		if (n_samples == WINDOW)
+			sum -= samples[next];
+		else
+			++n_samples;
+		samples[next] = value;
+		next = (next + 1) % WINDOW;
+		sum += value;
+	}
+
+	u32 size() const {
+		return n_samples;
+	}
+
+	u64 mean() const {
+		return n_samples == 0 ? 0 : sum / n_samples;
+	}
+
+	u64 max() const {
+		u64 out = 0;
+		for (u32 i = 0; i != n_samples; ++i)
+			out = std::max(out, samples[i]);
+		return out;
+	}
+
+	// `fraction` is in [0, 1]; e.g. 0.95 for the 95th percentile. Returns 0 if empty.
+	u64 percentile(double fraction) const {
+		check(fraction >= 0.0 && fraction <= 1.0);
+		if (n_samples == 0)
+			return 0;
+		u32 rank = std::max(1u, static_cast<u32>(std::ceil(fraction * n_samples)));
+		u64 scratch[WINDOW];
+		std::copy(samples, samples + n_samples, scratch);
+		u64* nth = scratch + (rank - 1);
+		std::nth_element(scratch, nth, scratch + n_samples);
+		return *nth;
+	}
+};
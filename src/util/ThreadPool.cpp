@@ -0,0 +1,167 @@
+#include "./ThreadPool.h"
+
+#include <algorithm> // std::find
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility> // exchange
+#include <vector>
+
+namespace {
+	struct Job {
+		// A copy, since a spawned job outlives the `spawn` call.
+		const std::function<void(u32)> cb;
+		const u32 n;
+		std::atomic<u32> next_index;
+		std::atomic<u32> n_done;
+		std::exception_ptr exception; // Guarded by ThreadPoolImpl::mutex
+
+		Job(const std::function<void(u32)>& _cb, u32 _n) : cb{_cb}, n{_n}, next_index{0}, n_done{0}, exception{} {}
+	};
+}
+
+struct ThreadPoolImpl {
+	std::mutex mutex;
+	std::condition_variable work_available;
+	std::condition_variable job_done;
+	// Jobs that may still have unclaimed indices.
+	std::deque<std::shared_ptr<Job>> jobs;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+	// Claims and runs indices until there are none left. Other threads may still be running indices they claimed.
+	void help_with(const std::shared_ptr<Job>& job) {
+		while (true) {
+			u32 i = job->next_index.fetch_add(1);
+			if (i >= job->n) {
+				std::lock_guard<std::mutex> lock { mutex };
+				auto it = std::find(jobs.begin(), jobs.end(), job);
+				if (it != jobs.end()) jobs.erase(it);
+				return;
+			}
+
+			try {
+				job->cb(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock { mutex };
+				if (!job->exception) job->exception = std::current_exception();
+			}
+
+			if (job->n_done.fetch_add(1) + 1 == job->n) {
+				// Lock so the waiting thread can't miss this between checking `n_done` and going to sleep.
+				std::lock_guard<std::mutex> lock { mutex };
+				job_done.notify_all();
+			}
+		}
+	}
+
+	void work() {
+		while (true) {
+			std::shared_ptr<Job> job;
+			{
+				std::unique_lock<std::mutex> lock { mutex };
+				work_available.wait(lock, [&]() { return stopping || !jobs.empty(); });
+				if (jobs.empty()) return; // stopping
+				job = jobs.front();
+			}
+			help_with(job);
+		}
+	}
+};
+
+ThreadPool::ThreadPool(u32 n_workers) : impl{new ThreadPoolImpl {}} {
+	for (u32 i = 0; i != n_workers; ++i)
+		impl->workers.emplace_back([this]() { impl->work(); });
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock { impl->mutex };
+		impl->stopping = true;
+	}
+	impl->work_available.notify_all();
+	for (std::thread& t : impl->workers)
+		t.join();
+	delete impl;
+}
+
+u32 ThreadPool::default_n_workers() {
+	u32 n_cores = std::thread::hardware_concurrency(); // 0 if unknown
+	return n_cores <= 1 ? 0 : n_cores - 1;
+}
+
+u32 ThreadPool::n_threads() const {
+	return ulong_to_u32(impl->workers.size()) + 1;
+}
+
+void TaskGroup::run(const std::function<void()>& task) {
+	std::exception_ptr thrown;
+	try {
+		task();
+	} catch (...) {
+		thrown = std::current_exception();
+	}
+
+	std::lock_guard<std::mutex> lock { mutex };
+	if (thrown && !exception) exception = thrown;
+	--n_pending;
+	task_done.notify_all();
+}
+
+void TaskGroup::wait(u32 max_pending) {
+	std::unique_lock<std::mutex> lock { mutex };
+	task_done.wait(lock, [&]() { return n_pending <= max_pending; });
+	// Taken out, so it's only thrown once.
+	if (exception)
+		std::rethrow_exception(std::exchange(exception, nullptr));
+}
+
+void TaskGroup::wait_ignoring_errors() {
+	std::unique_lock<std::mutex> lock { mutex };
+	task_done.wait(lock, [&]() { return n_pending == 0; });
+	exception = nullptr;
+}
+
+void ThreadPool::spawn(TaskGroup& group, std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock { group.mutex };
+		++group.n_pending;
+	}
+
+	if (impl->workers.empty()) {
+		group.run(task);
+		return;
+	}
+
+	// A job with one index. Nothing waits on `job_done` for it.
+	std::shared_ptr<Job> job = std::make_shared<Job>([&group, task](u32) { group.run(task); }, 1);
+	{
+		std::lock_guard<std::mutex> lock { impl->mutex };
+		impl->jobs.push_back(job);
+	}
+	impl->work_available.notify_one();
+}
+
+void ThreadPool::parallel_for(u32 n, const std::function<void(u32)>& cb) {
+	if (n == 0) return;
+
+	std::shared_ptr<Job> job = std::make_shared<Job>(cb, n);
+	if (n > 1 && !impl->workers.empty()) {
+		{
+			std::lock_guard<std::mutex> lock { impl->mutex };
+			impl->jobs.push_back(job);
+		}
+		impl->work_available.notify_all();
+	}
+
+	impl->help_with(job);
+
+	std::unique_lock<std::mutex> lock { impl->mutex };
+	impl->job_done.wait(lock, [&]() { return job->n_done.load() == n; });
+	if (job->exception)
+		std::rethrow_exception(job->exception);
+}
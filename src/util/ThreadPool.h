@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <new>
+
+#include "./DynArray.h"
+#include "./int.h"
+
+struct ThreadPoolImpl;
+
+// Tasks started with `ThreadPool::spawn`, so they can be waited for. Must outlive its tasks.
+class TaskGroup {
+	friend class ThreadPool;
+
+	std::mutex mutex;
+	std::condition_variable task_done;
+	u32 n_pending;
+	std::exception_ptr exception;
+
+	void run(const std::function<void()>& task);
+
+public:
+	TaskGroup() : n_pending{0}, exception{} {}
+	TaskGroup(const TaskGroup& other) = delete;
+
+	// Blocks until at most `max_pending` of the tasks are unfinished.
+	// Rethrows the first exception thrown by a task since the last `wait` that threw.
+	void wait(u32 max_pending = 0);
+	// Blocks until every task is finished, and drops any exception. For cleanup, which mustn't throw.
+	void wait_ignoring_errors();
+};
+
+/**
+ * A fixed set of worker threads.
+ * `parallel_for` blocks until every index has run. The calling thread runs indices too,
+ * so it may be called from inside another `parallel_for` without deadlocking.
+ */
+class ThreadPool {
+	ThreadPoolImpl* impl;
+
+public:
+	// By default, uses one worker per core besides the calling thread.
+	explicit ThreadPool(u32 n_workers = default_n_workers());
+	ThreadPool(const ThreadPool& other) = delete;
+	~ThreadPool();
+
+	static u32 default_n_workers();
+	// Workers plus the calling thread.
+	u32 n_threads() const;
+
+	// Calls `cb(i)` for every i in 0..n, in no particular order. Rethrows the first exception thrown by `cb`.
+	void parallel_for(u32 n, const std::function<void(u32)>& cb);
+
+	// Runs `task` on a worker and returns without waiting for it. (If there are no workers, runs it now.)
+	void spawn(TaskGroup& group, std::function<void()> task);
+};
+
+template <typename T>
+struct parallel_fill_array {
+	ThreadPool& pool;
+
+	template <typename Cb>
+	DynArray<T> operator()(u32 size, Cb cb) {
+		DynArray<T> out = DynArray<T>::uninitialized(size);
+		FillGuard<T> guard { out };
+		pool.parallel_for(size, [&](u32 i) {
+			guard.construct(i, cb(i));
+		});
+		guard.finish();
+		return out;
+	}
+};
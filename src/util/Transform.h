@@ -7,3 +7,8 @@ struct Transform {
 	glm::vec3 position;
 	glm::quat quat;
 };
+
+// `alpha` of 0 is `a`, 1 is `b`.
+inline Transform interpolate(const Transform& a, const Transform& b, float alpha) {
+	return Transform { glm::mix(a.position, b.position, alpha), glm::slerp(a.quat, b.quat, alpha) };
+}
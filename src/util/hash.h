@@ -0,0 +1,16 @@
+#pragma once
+
+#include "./int.h"
+#include "./Slice.h"
+
+const u64 FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+const u64 FNV_PRIME = 0x100000001b3ull;
+
+// FNV-1a. Pass the result of a previous call as `hash` to hash several slices together.
+inline u64 hash_bytes(Slice<char> bytes, u64 hash = FNV_OFFSET_BASIS) {
+	for (char c : bytes) {
+		hash ^= static_cast<u8>(c);
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
@@ -32,6 +32,10 @@ inline u8 u64_to_u8(u64 u) {
 	check(u <= std::numeric_limits<u8>::max());
 	return static_cast<u8>(u);
 }
+inline u16 u32_to_u16(u32 u) {
+	check(u <= std::numeric_limits<u16>::max());
+	return static_cast<u16>(u);
+}
 inline u8 u32_to_u8(u32 u) {
 	check(u <= std::numeric_limits<u8>::max());
 	return static_cast<u8>(u);
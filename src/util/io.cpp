@@ -1,8 +1,12 @@
 #include "./io.h"
 
+#include <cerrno>
+#include <fcntl.h> // open
 #include <fstream>
 #include <sstream>
-#include <unistd.h> // getcwd
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // getcwd, close
 
 #include "./assert.h"
 
@@ -42,3 +46,39 @@ std::string read_file(const std::string& file_name) {
 	buffer << i.rdbuf();
 	return buffer.str();
 }
+
+MappedFile MappedFile::open(const std::string& file_name) {
+	int fd = ::open(file_name.c_str(), O_RDONLY);
+	check(fd != -1);
+	return map_fd(fd);
+}
+
+MappedFile MappedFile::open_if_exists(const std::string& file_name) {
+	int fd = ::open(file_name.c_str(), O_RDONLY);
+	if (fd == -1) {
+		check(errno == ENOENT);
+		return MappedFile {};
+	}
+	return map_fd(fd);
+}
+
+MappedFile MappedFile::map_fd(int fd) {
+	struct stat st;
+	check(fstat(fd, &st) == 0);
+	u32 size = i64_to_u32(st.st_size);
+	// mmap of an empty file fails, but an empty slice is fine.
+	char* begin = nullptr;
+	if (size != 0) {
+		void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, /*offset*/ 0);
+		check(mapped != MAP_FAILED);
+		begin = static_cast<char*>(mapped);
+	}
+	// The mapping stays valid after the descriptor is closed.
+	close(fd);
+	return MappedFile { begin, size };
+}
+
+MappedFile::~MappedFile() {
+	if (_begin != nullptr)
+		munmap(_begin, _size);
+}
@@ -2,6 +2,38 @@
 
 #include <string>
 
+#include "./MutableSlice.h"
+#include "./Slice.h"
+
 std::string get_current_directory();
 
 std::string read_file(const std::string& file_name);
+
+/**
+ * A whole file, mapped into memory. Unmapped on destruction.
+ * The mapping is private: writes are copy-on-write and never reach the file.
+ */
+class MappedFile {
+	char* _begin;
+	u32 _size;
+
+	inline MappedFile(char* begin, u32 size) : _begin{begin}, _size{size} {}
+	// Takes ownership of `fd`.
+	static MappedFile map_fd(int fd);
+
+public:
+	inline MappedFile() : _begin{nullptr}, _size{0} {}
+	static MappedFile open(const std::string& file_name);
+	// Returns an empty MappedFile if the file does not exist.
+	static MappedFile open_if_exists(const std::string& file_name);
+	MappedFile(const MappedFile& other) = delete;
+	inline MappedFile(MappedFile&& other) : _begin{other._begin}, _size{other._size} {
+		other._begin = nullptr;
+		other._size = 0;
+	}
+	~MappedFile();
+
+	inline Slice<char> slice() const { return { _begin, _size }; }
+	inline MutableSlice<char> mutable_slice() { return { _begin, _size }; }
+	inline u32 size() const { return _size; }
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstring>
 #include <string>
 #include "./Slice.h"
 
@@ -7,3 +8,10 @@ inline Slice<char> to_slice(const std::string& s) {
 	return Slice<char> { s.begin().base(), ulong_to_u32(s.size()) };
 }
 
+inline bool slice_equals(const Slice<char>& a, const Slice<char>& b) {
+	return a.size() == b.size() && (a.size() == 0 || memcmp(a.begin(), b.begin(), a.size()) == 0);
+}
+
+inline bool slice_equals(const Slice<char>& a, const char* b) {
+	return slice_equals(a, Slice<char> { b, ulong_to_u32(strlen(b)) });
+}